@@ -0,0 +1,287 @@
+#include "bruteforce.h"
+#include "util.h"
+#include <stdlib.h>
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// Squared distance computed the direct way.
+static double sq_distance(int d, const double *x, const double *y) {
+  double dist = 0;
+  for (int j = 0; j < d; j++) {
+    double diff = x[j] - y[j];
+    dist += diff * diff;
+  }
+  return dist;
+}
+
+// Squared length of a vector.
+static double sq_norm(int d, const double *x) {
+  double sum = 0;
+  for (int j = 0; j < d; j++) {
+    sum += x[j] * x[j];
+  }
+  return sum;
+}
+
+// Find the neighbours of a single query and write them to 'closest',
+// which must have room for 'k' elements.  'dists' is scratch space for
+// 'k' distances.
+static void knn_into(int k, int d, int n, const double *points,
+                     const double *query, int *closest, double *dists) {
+  struct knn_heap heap;
+  knn_heap_init(&heap, k, dists, closest);
+
+  for (int i = 0; i < n; i++) {
+    double dist = sq_distance(d, &points[(size_t)i*d], query);
+    if (dist <= knn_heap_radius(&heap)) {
+      knn_heap_push(&heap, dist, i);
+    }
+  }
+
+  knn_heap_sort(&heap);
+}
+
+int* knn(int k, int d, int n, const double *points, const double* query) {
+  int *closest = malloc(k * sizeof(int));
+  double *dists = malloc(k * sizeof(double));
+  knn_into(k, d, n, points, query, closest, dists);
+  free(dists);
+  return closest;
+}
+
+// The batched version computes all query/point distances as a blocked
+// matrix product, using
+//
+//   |q-p|² = |q|² + |p|² - 2 q·p
+//
+// Blocks of QUERY_BLOCK queries are compared against blocks of
+// reference points of at most POINT_BLOCK_DOUBLES coordinates, which
+// are copied to struct-of-arrays form so the micro-kernel can load MR_POINTS
+// consecutive points with one vector load.  The micro-kernel computes
+// an MR_QUERIES by MR_POINTS tile of dot products, kept entirely in
+// registers.
+//
+// The expanded formula suffers from cancellation, so its distances
+// are only used as a filter.  The norms are scaled down so that the
+// approximate distance is never larger than the true one, and only
+// points whose approximate distance is within the current radius are
+// passed on to the heap, with their distance computed directly as in
+// knn_into().  This means the result is exactly the same as from knn(),
+// while almost all points are rejected by the fast kernel.
+#define QUERY_BLOCK 64
+#define POINT_BLOCK_DOUBLES 16384
+#define MR_QUERIES 4
+#define MR_POINTS 8
+
+// Compute the dot products of 'MR_QUERIES' queries (given by pointers,
+// since the last tile may repeat some) with the 'MR_POINTS' points
+// starting at 'packed', which holds coordinate 'j' of point 'p' at
+// 'packed[j*stride+p]'.  The result for query 'r' and point 'p' is
+// written to 'out[r*MR_POINTS+p]'.
+static void dot_tile(int d, const double **qs, const double *packed, int stride,
+                     double *out) {
+#if defined(__AVX__)
+  __m256d acc[MR_QUERIES][2];
+  for (int r = 0; r < MR_QUERIES; r++) {
+    acc[r][0] = _mm256_setzero_pd();
+    acc[r][1] = _mm256_setzero_pd();
+  }
+  for (int j = 0; j < d; j++) {
+    __m256d p0 = _mm256_loadu_pd(&packed[j*stride]);
+    __m256d p1 = _mm256_loadu_pd(&packed[j*stride+4]);
+    for (int r = 0; r < MR_QUERIES; r++) {
+      __m256d q = _mm256_set1_pd(qs[r][j]);
+      acc[r][0] = _mm256_add_pd(acc[r][0], _mm256_mul_pd(q, p0));
+      acc[r][1] = _mm256_add_pd(acc[r][1], _mm256_mul_pd(q, p1));
+    }
+  }
+  for (int r = 0; r < MR_QUERIES; r++) {
+    _mm256_storeu_pd(&out[r*MR_POINTS], acc[r][0]);
+    _mm256_storeu_pd(&out[r*MR_POINTS+4], acc[r][1]);
+  }
+#else
+  double acc[MR_QUERIES][MR_POINTS] = {{0}};
+  for (int j = 0; j < d; j++) {
+    for (int r = 0; r < MR_QUERIES; r++) {
+      double q = qs[r][j];
+      for (int p = 0; p < MR_POINTS; p++) {
+        acc[r][p] += q * packed[j*stride+p];
+      }
+    }
+  }
+  for (int r = 0; r < MR_QUERIES; r++) {
+    for (int p = 0; p < MR_POINTS; p++) {
+      out[r*MR_POINTS+p] = acc[r][p];
+    }
+  }
+#endif
+}
+
+// Bound on the rounding error of the expanded formula, relative to
+// |q|²+|p|².  Scaling both norms by (1-norm_slack(d)) makes the
+// expanded distance a lower bound of the true distance.
+static double norm_slack(int d) {
+  return 4 * (d+2) * DBL_EPSILON;
+}
+
+// Process queries 'q0' up to 'q1' against all reference points.
+// 'point_norms' holds the scaled squared norms of the points, and
+// 'heap_dists' has room for 'QUERY_BLOCK*k' distances and 'packed'
+// for a block of points.
+static void knn_block(int k, int d, int n, const double *points,
+                      const double *point_norms, int point_block,
+                      const double *queries, int q0, int q1,
+                      int *out_indexes, double *heap_dists, double *packed) {
+  int nq = q1 - q0;
+  struct knn_heap heaps[QUERY_BLOCK];
+  double query_norms[QUERY_BLOCK];
+  for (int r = 0; r < nq; r++) {
+    knn_heap_init(&heaps[r], k, &heap_dists[r*k], &out_indexes[(size_t)(q0+r)*k]);
+    query_norms[r] = sq_norm(d, &queries[(size_t)(q0+r)*d]) * (1-norm_slack(d));
+  }
+
+  for (int lo = 0; lo < n; lo += point_block) {
+    int len = n - lo < point_block ? n - lo : point_block;
+    int padded = (len + MR_POINTS-1) / MR_POINTS * MR_POINTS;
+
+    // Transpose the block, padding with zeroes to whole tiles.
+    for (int j = 0; j < d; j++) {
+      for (int p = 0; p < len; p++) {
+        packed[j*padded+p] = points[(size_t)(lo+p)*d+j];
+      }
+      for (int p = len; p < padded; p++) {
+        packed[j*padded+p] = 0;
+      }
+    }
+
+    for (int r0 = 0; r0 < nq; r0 += MR_QUERIES) {
+      const double *qs[MR_QUERIES];
+      for (int r = 0; r < MR_QUERIES; r++) {
+        int row = r0+r < nq ? r0+r : r0;
+        qs[r] = &queries[(size_t)(q0+row)*d];
+      }
+
+      for (int p0 = 0; p0 < len; p0 += MR_POINTS) {
+        double dots[MR_QUERIES*MR_POINTS];
+        dot_tile(d, qs, &packed[p0], padded, dots);
+
+        for (int r = 0; r < MR_QUERIES && r0+r < nq; r++) {
+          struct knn_heap *heap = &heaps[r0+r];
+          double radius = knn_heap_radius(heap);
+          double approx[MR_POINTS];
+          int any = 0;
+          for (int p = 0; p < MR_POINTS; p++) {
+            approx[p] = query_norms[r0+r] + point_norms[lo+p0+p]
+              - 2*dots[r*MR_POINTS+p];
+            any |= approx[p] <= radius;
+          }
+          if (!any) {
+            continue;
+          }
+
+          for (int p = 0; p < MR_POINTS && p0+p < len; p++) {
+            int i = lo+p0+p;
+            if (approx[p] <= knn_heap_radius(heap)) {
+              double dist = sq_distance(d, &points[(size_t)i*d], qs[r]);
+              if (dist <= knn_heap_radius(heap)) {
+                knn_heap_push(heap, dist, i);
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  for (int r = 0; r < nq; r++) {
+    knn_heap_sort(&heaps[r]);
+  }
+}
+
+void knn_batch(int k, int d, int n, const double *points,
+               int nq, const double *queries, int *out_indexes) {
+  // Size the point blocks so that a packed block stays in L1/L2 cache
+  // while all queries of a block are compared against it.
+  int point_block = POINT_BLOCK_DOUBLES / (d > 0 ? d : 1);
+  point_block = point_block / MR_POINTS * MR_POINTS;
+  if (point_block < MR_POINTS) {
+    point_block = MR_POINTS;
+  }
+
+  // The norms are scaled down by the rounding error bound, so the
+  // expanded distances never exceed the true ones.  There is padding
+  // at the end for the last tile.
+  double *point_norms = malloc(((size_t)n + MR_POINTS) * sizeof(double));
+#pragma omp parallel for
+  for (int i = 0; i < n; i++) {
+    point_norms[i] = sq_norm(d, &points[(size_t)i*d]) * (1-norm_slack(d));
+  }
+  for (int i = n; i < n + MR_POINTS; i++) {
+    point_norms[i] = INFINITY;
+  }
+
+#pragma omp parallel
+  {
+    // Each thread has its own heap storage for distances and its own
+    // packed point block; the indexes are kept directly in the output.
+    double *heap_dists = malloc((size_t)QUERY_BLOCK * k * sizeof(double));
+    double *packed = malloc((size_t)point_block * d * sizeof(double));
+
+#pragma omp for schedule(dynamic, 1)
+    for (int q0 = 0; q0 < nq; q0 += QUERY_BLOCK) {
+      int q1 = q0 + QUERY_BLOCK < nq ? q0 + QUERY_BLOCK : nq;
+      knn_block(k, d, n, points, point_norms, point_block,
+                queries, q0, q1, out_indexes, heap_dists, packed);
+    }
+
+    free(packed);
+    free(heap_dists);
+  }
+
+  free(point_norms);
+}
+
+static void knn_into_f32(int k, int d, int n, const float *points,
+                         const float *query, int *closest, double *dists) {
+  struct knn_heap heap;
+  knn_heap_init(&heap, k, dists, closest);
+
+  for (int i = 0; i < n; i++) {
+    const float *p = &points[(size_t)i*d];
+    float dist = 0;
+    for (int j = 0; j < d; j++) {
+      float diff = p[j] - query[j];
+      dist += diff * diff;
+    }
+    if (dist <= knn_heap_radius(&heap)) {
+      knn_heap_push(&heap, dist, i);
+    }
+  }
+
+  knn_heap_sort(&heap);
+}
+
+void knn_batch_f32(int k, int d, int n, const float *points,
+                   int nq, const double *queries, int *out_indexes) {
+#pragma omp parallel
+  {
+    double *dists = malloc(k * sizeof(double));
+    float *query = malloc(d * sizeof(float));
+
+#pragma omp for schedule(dynamic, 16)
+    for (int q = 0; q < nq; q++) {
+      for (int j = 0; j < d; j++) {
+        query[j] = queries[(size_t)q*d+j];
+      }
+      knn_into_f32(k, d, n, points, query, &out_indexes[(size_t)q*k], dists);
+    }
+
+    free(query);
+    free(dists);
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef KNN_BRUTEFORCE_H
+#define KNN_BRUTEFORCE_H
+
+// Brute-force k-nearest-neighbours.
+//
+// 'k' is the number of neighbours to find.
+//
+// 'd' is the number of dimensions in the space.
+//
+// 'n' is the number of reference points.
+//
+// 'query' is the query point that we are finding neighbours for.
+//
+// Returns a freshly allocated 'k'-element array that contains the
+// indexes of the nearest neighbours to 'query' in 'points'.  It is
+// the responsibility of the caller to free this array.
+int* knn(int k, int d, int n, const double *points, const double* query);
+
+// Brute-force k-nearest-neighbours for many queries at once.
+//
+// 'nq' is the number of queries, and 'queries' is an 'nq'-element
+// array of query points.
+//
+// The indexes of the 'k' nearest neighbours of query 'q' are written
+// to 'out_indexes[q*k]' through 'out_indexes[q*k+k-1]', in the same
+// order as knn() would return them.  The caller must provide room for
+// 'nq*k' elements.
+//
+// The queries are processed in parallel with OpenMP, and nothing is
+// allocated per query.  Distances are computed in cache-sized blocks
+// of queries and points as a matrix product, which is much faster
+// than knn() for many queries, but gives exactly the same result.
+void knn_batch(int k, int d, int n, const double *points,
+               int nq, const double *queries, int *out_indexes);
+
+// Like knn_batch(), but for single precision reference points.  The
+// queries are rounded to single precision, and distances are computed
+// in single precision.
+void knn_batch_f32(int k, int d, int n, const float *points,
+                   int nq, const double *queries, int *out_indexes);
+
+#endif
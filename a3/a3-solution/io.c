@@ -0,0 +1,291 @@
+// For mmap() and friends.
+#define _POSIX_C_SOURCE 200112L
+
+#include "io.h"
+#include "outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Split the 'd' field of a points file header into the number of
+// dimensions and the point type.  Returns 1 if the type is unknown.
+static int decode_dims(int32_t field, int32_t *d, enum point_type *type) {
+  *d = field & ((1<<POINT_TYPE_SHIFT)-1);
+  int32_t t = field >> POINT_TYPE_SHIFT;
+  if (t != POINT_F64 && t != POINT_F32) {
+    return 1;
+  }
+  *type = t;
+  return 0;
+}
+
+double* read_points(FILE *f, int* n_out, int *d_out) {
+  int read;
+  int32_t n, d, d_field;
+  enum point_type type;
+
+  read = fread(&n, sizeof(int32_t), 1, f);
+  if (read != 1) {
+    return NULL;
+  }
+
+  read = fread(&d_field, sizeof(int32_t), 1, f);
+  if (read != 1 || decode_dims(d_field, &d, &type) != 0) {
+    return NULL;
+  }
+
+  double* data = malloc((size_t)n*d*sizeof(double));
+
+  if (type == POINT_F32) {
+    // Read one point at a time and convert it.
+    float *point = malloc(d*sizeof(float));
+    for (read = 0; read < n; read++) {
+      if (fread(point, d*sizeof(float), 1, f) != 1) {
+        break;
+      }
+      for (int j = 0; j < d; j++) {
+        data[(size_t)read*d+j] = point[j];
+      }
+    }
+    free(point);
+  } else {
+    read = fread(data, d*sizeof(double), n, f);
+  }
+
+  if (read != n) {
+    free(data);
+    return NULL;
+  } else {
+    *n_out = n;
+    *d_out = d;
+    return data;
+  }
+}
+
+int* read_indexes(FILE *f, int *n_out, int *k_out) {
+  int read;
+  int32_t n, k;
+
+  read = fread(&n, sizeof(int32_t), 1, f);
+  if (read != 1) {
+    return NULL;
+  }
+
+  read = fread(&k, sizeof(int32_t), 1, f);
+  if (read != 1) {
+    return NULL;
+  }
+
+  int* data = malloc(n*k*sizeof(int));
+
+  read = fread(data, k*sizeof(int), n, f);
+
+  if (read != n) {
+    free(data);
+    return NULL;
+  } else {
+    *n_out = n;
+    *k_out = k;
+    return data;
+  }
+}
+
+
+int write_points_header(FILE *f, int32_t n, int32_t d, enum point_type type) {
+  int32_t d_field = d | (type << POINT_TYPE_SHIFT);
+
+  // Write number of points.
+  if (fwrite(&n, sizeof(int32_t), 1, f) != 1) {
+    return 1;
+  }
+
+  // Write number of values for each point (dimensionality).
+  if (fwrite(&d_field, sizeof(int32_t), 1, f) != 1) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int write_points(FILE *f, int32_t n, int32_t d, double *data) {
+  if (write_points_header(f, n, d, POINT_F64) != 0) {
+    return 1;
+  }
+
+  // Write the raw point data.
+  if ((int)fwrite(data, d*sizeof(double), n, f) != n) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int write_points_f32(FILE *f, int32_t n, int32_t d, float *data) {
+  if (write_points_header(f, n, d, POINT_F32) != 0) {
+    return 1;
+  }
+
+  if ((int)fwrite(data, d*sizeof(float), n, f) != n) {
+    return 1;
+  }
+
+  return 0;
+}
+
+int write_indexes(FILE *f, int32_t n, int32_t k, int *data) {
+  // Write number of points.
+  if (fwrite(&n, sizeof(int32_t), 1, f) != 1) {
+    return 1;
+  }
+
+  // Write number of indexes for each point.
+  if (fwrite(&k, sizeof(int32_t), 1, f) != 1) {
+    return 1;
+  }
+
+  // Write the raw point data.
+  if ((int)fwrite(data, k*sizeof(int), n, f) != n) {
+    return 1;
+  }
+
+  return 0;
+}
+
+// Map a file consisting of two int32_t header fields followed by some
+// data.  Returns a pointer to the data, and writes the header fields
+// to 'a_out' and 'b_out'.  The caller must check that the file is
+// large enough for the data.
+static const void* map_file(const char *filename, enum map_access access,
+                            int *a_out, int *b_out, struct file_map *map) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < 2*sizeof(int32_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  int advice;
+  switch (access) {
+  case ACCESS_SEQUENTIAL: advice = POSIX_MADV_SEQUENTIAL; break;
+  case ACCESS_RANDOM: advice = POSIX_MADV_RANDOM; break;
+  default: advice = POSIX_MADV_NORMAL; break;
+  }
+  posix_madvise(addr, st.st_size, advice);
+
+  map->addr = addr;
+  map->len = st.st_size;
+  map->converted = NULL;
+
+  const int32_t *header = addr;
+  *a_out = header[0];
+  *b_out = header[1];
+  return header + 2;
+}
+
+// Check that a mapping has room for 'a*b' elements of 'elem_size'
+// bytes after the header, as touching beyond the end of the file would
+// crash with SIGBUS.  If not, the mapping is removed and 0 returned.
+static int map_covers(struct file_map *map, int a, int b, size_t elem_size) {
+  if (a < 0 || b < 0 ||
+      map->len < 2*sizeof(int32_t) + (size_t)a*b*elem_size) {
+    unmap_file(map);
+    return 0;
+  }
+  return 1;
+}
+
+const void* map_points_typed(const char *filename, enum map_access access,
+                             int *n_out, int *d_out, enum point_type *type_out,
+                             struct file_map *map) {
+  int n, d_field;
+  const void *data = map_file(filename, access, &n, &d_field, map);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  int32_t d;
+  enum point_type type;
+  if (decode_dims(d_field, &d, &type) != 0) {
+    unmap_file(map);
+    return NULL;
+  }
+
+  if (!map_covers(map, n, d, type == POINT_F32 ? sizeof(float) : sizeof(double))) {
+    return NULL;
+  }
+
+  *n_out = n;
+  *d_out = d;
+  *type_out = type;
+  return data;
+}
+
+const double* map_points(const char *filename, enum map_access access,
+                         int *n_out, int *d_out, struct file_map *map) {
+  enum point_type type;
+  const void *data = map_points_typed(filename, access, n_out, d_out, &type, map);
+  if (data == NULL || type == POINT_F64) {
+    return data;
+  }
+
+  size_t size = (size_t)*n_out * *d_out;
+  const float *floats = data;
+  double *doubles = malloc(size*sizeof(double));
+  for (size_t i = 0; i < size; i++) {
+    doubles[i] = floats[i];
+  }
+  map->converted = doubles;
+  return doubles;
+}
+
+const int* map_indexes(const char *filename, enum map_access access,
+                       int *n_out, int *k_out, struct file_map *map) {
+  const int *data = map_file(filename, access, n_out, k_out, map);
+  if (data == NULL || !map_covers(map, *n_out, *k_out, sizeof(int))) {
+    return NULL;
+  }
+  return data;
+}
+
+void unmap_file(struct file_map *map) {
+  munmap(map->addr, map->len);
+  free(map->converted);
+  map->addr = NULL;
+  map->len = 0;
+  map->converted = NULL;
+}
+
+void write_indexes_buf(struct outbuf *out, int32_t n, int32_t k, const int *data) {
+  outbuf_write(out, &n, sizeof(int32_t));
+  outbuf_write(out, &k, sizeof(int32_t));
+  outbuf_write(out, data, (size_t)n * k * sizeof(int));
+}
+
+void print_indexes(struct outbuf *out, int32_t n, int32_t k, const int *data) {
+  for (int i = 0; i < n; i++) {
+    outbuf_str(out, "Query ");
+    outbuf_int(out, i);
+    outbuf_str(out, ": ");
+    for (int j = 0; j < k; j++) {
+      outbuf_int(out, data[(size_t)i*k+j]);
+      outbuf_char(out, ' ');
+    }
+    outbuf_char(out, '\n');
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef KNN_IO_H
+#define KNN_IO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// The coordinates in a points data file are normally doubles, but can
+// also be single precision floats, which halves the size of the file
+// (and of the memory traffic when searching it).  The type is recorded
+// in the 'd' field of the header: the low POINT_TYPE_SHIFT bits are
+// the number of dimensions, and the bits above that are a point_type.
+// Files that predate this have zeroes there, meaning doubles.
+#define POINT_TYPE_SHIFT 24
+
+enum point_type {
+  POINT_F64 = 0,
+  POINT_F32 = 1
+};
+
+// Read points from a points data file.  Returns a pointer to the
+// data, and writes the size to the n_out and d_out arguments.
+// Returns a NULL pointer if reading fails.  It is the caller's
+// responsibility to eventually free the returned pointer with free().
+// Single precision files are converted to doubles.
+double* read_points(FILE *f, int *n_out, int* d_out);
+
+// Read indexes from an indexes data file.  Returns a pointer to the
+// data, and writes the size to the n_out and k_out arguments.
+// Returns a NULL pointer if reading fails.  It is the caller's
+// responsibility to eventually free the returned pointer with free().
+int* read_indexes(FILE *f, int *n_out, int* k_out);
+
+// Write just the header of a points data file with 'n' points of
+// dimension 'd' and the given type, for writing the coordinates
+// separately, e.g. a chunk at a time.  Returns 1 on error and 0 on
+// success.
+int write_points_header(FILE *f, int32_t n, int32_t d, enum point_type type);
+
+// Write a points data file based on the given data.  Returns 1 on
+// error and 0 on success.
+int write_points(FILE *f, int32_t n, int32_t d, double *data);
+
+// Like write_points(), but write single precision coordinates.
+int write_points_f32(FILE *f, int32_t n, int32_t d, float *data);
+
+// Write an indexes data file based on the given data.  Returns 1 on
+// error and 0 on success.
+int write_indexes(FILE *f, int32_t n, int32_t k, int *data);
+
+// Defined in outbuf.h.
+struct outbuf;
+
+// Like write_indexes(), but through an outbuf, which can avoid stdio
+// and the page cache.  Errors are reported by outbuf_close().
+void write_indexes_buf(struct outbuf *out, int32_t n, int32_t k, const int *data);
+
+// Print the indexes as text, one line of the form
+//
+//   Query 0: 12 7 3
+//
+// per query.  This formats the numbers by hand, as printf() is slow
+// enough to dominate the running time of a fast search.
+void print_indexes(struct outbuf *out, int32_t n, int32_t k, const int *data);
+
+// A read-only memory mapping of a data file, as set up by
+// map_points() or map_indexes().
+struct file_map {
+  void *addr;
+  size_t len;
+
+  // Data converted from the file by map_points(), if any.
+  void *converted;
+};
+
+// How a mapped file is going to be accessed.  This is passed on to the
+// kernel as a hint, and controls how aggressively it reads ahead.
+enum map_access {
+  ACCESS_NORMAL,
+  ACCESS_SEQUENTIAL,
+  ACCESS_RANDOM
+};
+
+// Like read_points(), but instead of reading the file into memory,
+// map it read-only and return a pointer to the point data just after
+// the header.  Nothing is read up front: pages are loaded from disk
+// the first time they are touched, so this returns almost immediately
+// even for very large files.  Returns a NULL pointer on failure.  The
+// returned pointer is valid until unmap_file() is called on 'map'.
+//
+// If the file contains single precision coordinates, they are read
+// and converted to doubles, so this is no faster than read_points().
+// Use map_points_typed() to avoid that.
+const double* map_points(const char *filename, enum map_access access,
+                         int *n_out, int *d_out, struct file_map *map);
+
+// Like map_points(), but never converts anything.  The type of the
+// coordinates is written to 'type_out', and the returned pointer is
+// to either doubles or floats accordingly.
+const void* map_points_typed(const char *filename, enum map_access access,
+                             int *n_out, int *d_out, enum point_type *type_out,
+                             struct file_map *map);
+
+// Like map_points(), but for an indexes data file.
+const int* map_indexes(const char *filename, enum map_access access,
+                       int *n_out, int *k_out, struct file_map *map);
+
+// Remove a mapping produced by map_points() or map_indexes().
+void unmap_file(struct file_map *map);
+
+#endif
@@ -0,0 +1,120 @@
+// Benchmark of the updatable k-d forest against rebuilding a static
+// k-d tree after every change.  The forest is filled with 'n' random
+// points, after which each update deletes a random point and inserts
+// a new one.  Finally the forest is queried, and checked against a
+// static tree built from the same points.  See the 'bench-forest'
+// rule in the Makefile.
+
+#include "kdforest.h"
+#include "kdtree.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void random_point(int d, double *p) {
+  for (int j = 0; j < d; j++) {
+    p[j] = ((double)rand())/RAND_MAX;
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 6) {
+    fprintf(stderr, "Usage: %s <n> <d> <updates> <queries> <k>\n", argv[0]);
+    exit(1);
+  }
+
+  int n = atoi(argv[1]);
+  int d = atoi(argv[2]);
+  int n_updates = atoi(argv[3]);
+  int n_queries = atoi(argv[4]);
+  int k = atoi(argv[5]);
+  assert(n > 0 && d > 0 && n_updates >= 0 && n_queries > 0 && k > 0);
+
+  srand(1);
+
+  // The points in the forest, indexed by identifier.  The forest never
+  // holds more than 'n' points, and reuses the identifiers of deleted
+  // points, so all identifiers are below 'n'.
+  double *all = malloc((size_t)n * d * sizeof(double));
+  double *point = malloc(d * sizeof(double));
+
+  struct kdforest *forest = kdforest_create(d);
+
+  double start = seconds();
+  for (int i = 0; i < n; i++) {
+    random_point(d, point);
+    int id = kdforest_insert(forest, point);
+    assert(id == i);
+    memcpy(&all[(size_t)id*d], point, d * sizeof(double));
+  }
+  double insert = seconds() - start;
+
+  start = seconds();
+  for (int u = 0; u < n_updates; u++) {
+    int victim = rand() % n;
+    int err = kdforest_delete(forest, victim);
+    assert(err == 0);
+
+    random_point(d, point);
+    int id = kdforest_insert(forest, point);
+    assert(id >= 0 && id < n);
+    memcpy(&all[(size_t)id*d], point, d * sizeof(double));
+  }
+  double update = seconds() - start;
+  assert(kdforest_size(forest) == n);
+
+  // The alternative: rebuild a static tree from the current points.
+  // Point 'i' of the tree is the point with identifier 'i', so both
+  // structures break ties between equally distant points the same way.
+  start = seconds();
+  struct kdtree *tree = kdtree_create(d, n, all);
+  double rebuild = seconds() - start;
+
+  double *queries = malloc((size_t)n_queries * d * sizeof(double));
+  for (int q = 0; q < n_queries; q++) {
+    random_point(d, &queries[(size_t)q*d]);
+  }
+
+  int *forest_ids = malloc((size_t)n_queries * k * sizeof(int));
+  int *tree_indexes = malloc((size_t)n_queries * k * sizeof(int));
+
+  start = seconds();
+  kdforest_knn_batch(forest, k, n_queries, queries, forest_ids);
+  double forest_query = seconds() - start;
+
+  start = seconds();
+  kdtree_knn_batch(tree, k, n_queries, queries, tree_indexes);
+  double tree_query = seconds() - start;
+
+  int mismatches = 0;
+  for (int i = 0; i < n_queries*k; i++) {
+    mismatches += forest_ids[i] != tree_indexes[i];
+  }
+
+  printf("%s: n=%d d=%d updates=%d queries=%d k=%d\n",
+         argv[0], n, d, n_updates, n_queries, k);
+  printf("Inserting %d points: %.3fs (%.2fus/insert)\n",
+         n, insert, insert/n*1e6);
+  printf("Rebuilding static tree: %.3fs\n", rebuild);
+  if (n_updates > 0) {
+    printf("Updates: %.3fs (%.2fus/update, %.0fx cheaper than a rebuild)\n",
+           update, update/n_updates*1e6, rebuild/(update/n_updates));
+  }
+  printf("Queries on forest: %.3fs (%.2fus/query)\n",
+         forest_query, forest_query/n_queries*1e6);
+  printf("Queries on static tree: %.3fs (%.2fus/query)\n",
+         tree_query, tree_query/n_queries*1e6);
+  printf("Mismatches: %d\n", mismatches);
+
+  kdforest_free(forest);
+  kdtree_free(tree);
+  free(all);
+  free(point);
+  free(queries);
+  free(forest_ids);
+  free(tree_indexes);
+
+  return mismatches != 0;
+}
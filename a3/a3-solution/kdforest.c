@@ -0,0 +1,281 @@
+#include "kdforest.h"
+#include "kdtree.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+// Inserted points are collected here until there are this many, at
+// which point they are built into a tree.
+#define BUFFER_SIZE 256
+
+// Enough levels for any 'int' number of points.
+#define MAX_LEVELS 32
+
+// Where a point lives, as recorded in 'level_of'.
+#define IN_BUFFER (-1)
+#define DELETED (-2)
+
+struct level {
+  // NULL if the level is empty.
+  struct kdtree *tree;
+
+  // Number of points in the tree, including deleted ones.
+  int n;
+  int n_deleted;
+
+  // 'ids[i]' is the identifier of point 'i' in the tree, or -1 if it
+  // has been deleted.  This is exactly what kdtree_knn_heap() wants.
+  int *ids;
+};
+
+struct kdforest {
+  int d;
+
+  // Number of identifiers handed out, and coordinates of the points,
+  // indexed by identifier.
+  int n_ids;
+  int capacity;
+  double *coords;
+
+  // For each identifier, the level containing the point (or IN_BUFFER
+  // or DELETED), and its position within the level or buffer.
+  int *level_of;
+  int *pos_of;
+
+  // The identifiers of deleted points, which are reused before new
+  // ones are handed out, as a linked list through 'pos_of'.  -1 if
+  // there are none.  A deleted point is no longer referenced by any
+  // level, so its identifier can be reused at once.
+  int free_ids;
+
+  int n_live;
+
+  int buffer_n;
+  int buffer[BUFFER_SIZE];
+
+  struct level levels[MAX_LEVELS];
+};
+
+struct kdforest *kdforest_create(int d) {
+  struct kdforest *forest = calloc(1, sizeof(struct kdforest));
+  forest->d = d;
+  forest->free_ids = -1;
+  return forest;
+}
+
+void kdforest_free(struct kdforest *forest) {
+  for (int l = 0; l < MAX_LEVELS; l++) {
+    if (forest->levels[l].tree != NULL) {
+      kdtree_free(forest->levels[l].tree);
+      free(forest->levels[l].ids);
+    }
+  }
+  free(forest->coords);
+  free(forest->level_of);
+  free(forest->pos_of);
+  free(forest);
+}
+
+int kdforest_size(const struct kdforest *forest) {
+  return forest->n_live;
+}
+
+// Append the identifiers of the live points of level 'l' to 'ids',
+// and empty the level.  Returns the new number of identifiers.
+static int take_level(struct kdforest *forest, int l, int *ids, int n) {
+  struct level *level = &forest->levels[l];
+  for (int i = 0; i < level->n; i++) {
+    if (level->ids[i] >= 0) {
+      ids[n++] = level->ids[i];
+    }
+  }
+  kdtree_free(level->tree);
+  free(level->ids);
+  level->tree = NULL;
+  level->ids = NULL;
+  level->n = 0;
+  level->n_deleted = 0;
+  return n;
+}
+
+// Build level 'l' from the 'n' points whose identifiers are in 'ids',
+// which the level takes ownership of.  The level must be empty.
+static void build_level(struct kdforest *forest, int l, int *ids, int n) {
+  struct level *level = &forest->levels[l];
+  assert(level->tree == NULL);
+  if (n == 0) {
+    free(ids);
+    return;
+  }
+
+  // The tree wants its points contiguous, but copies them, so this
+  // array is only needed while building.
+  int d = forest->d;
+  double *points = malloc((size_t)n * d * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    memcpy(&points[(size_t)i*d], &forest->coords[(size_t)ids[i]*d],
+           d * sizeof(double));
+    forest->level_of[ids[i]] = l;
+    forest->pos_of[ids[i]] = i;
+  }
+
+  level->tree = kdtree_create(d, n, points);
+  level->ids = ids;
+  level->n = n;
+  level->n_deleted = 0;
+
+  free(points);
+}
+
+// Move the buffer into a tree, merging it with all the smallest
+// levels that are occupied.  The result always fits in the first
+// level that is empty, as level 'l' holds at most BUFFER_SIZE*2^l
+// points.
+static void flush_buffer(struct kdforest *forest) {
+  int l = 0;
+  int n = forest->buffer_n;
+  while (forest->levels[l].tree != NULL) {
+    n += forest->levels[l].n - forest->levels[l].n_deleted;
+    l++;
+  }
+  assert(l < MAX_LEVELS);
+
+  int *ids = malloc(n * sizeof(int));
+  memcpy(ids, forest->buffer, forest->buffer_n * sizeof(int));
+  int m = forest->buffer_n;
+  for (int i = 0; i < l; i++) {
+    m = take_level(forest, i, ids, m);
+  }
+  assert(m == n);
+  forest->buffer_n = 0;
+
+  build_level(forest, l, ids, n);
+}
+
+int kdforest_insert(struct kdforest *forest, const double *point) {
+  int d = forest->d;
+  int id;
+
+  if (forest->free_ids >= 0) {
+    id = forest->free_ids;
+    forest->free_ids = forest->pos_of[id];
+  } else {
+    if (forest->n_ids == forest->capacity) {
+      forest->capacity = forest->capacity == 0 ? BUFFER_SIZE : 2*forest->capacity;
+      forest->coords = realloc(forest->coords,
+                               (size_t)forest->capacity * d * sizeof(double));
+      forest->level_of = realloc(forest->level_of, forest->capacity * sizeof(int));
+      forest->pos_of = realloc(forest->pos_of, forest->capacity * sizeof(int));
+    }
+    id = forest->n_ids++;
+  }
+
+  memcpy(&forest->coords[(size_t)id*d], point, d * sizeof(double));
+  forest->level_of[id] = IN_BUFFER;
+  forest->pos_of[id] = forest->buffer_n;
+  forest->buffer[forest->buffer_n++] = id;
+  forest->n_live++;
+
+  if (forest->buffer_n == BUFFER_SIZE) {
+    flush_buffer(forest);
+  }
+
+  return id;
+}
+
+int kdforest_delete(struct kdforest *forest, int id) {
+  if (id < 0 || id >= forest->n_ids || forest->level_of[id] == DELETED) {
+    return 1;
+  }
+
+  int l = forest->level_of[id];
+  int pos = forest->pos_of[id];
+  forest->level_of[id] = DELETED;
+  forest->pos_of[id] = forest->free_ids;
+  forest->free_ids = id;
+  forest->n_live--;
+
+  if (l == IN_BUFFER) {
+    // Move the last point of the buffer into the hole.
+    int last = forest->buffer[--forest->buffer_n];
+    forest->buffer[pos] = last;
+    forest->pos_of[last] = pos;
+    return 0;
+  }
+
+  struct level *level = &forest->levels[l];
+  level->ids[pos] = -1;
+  level->n_deleted++;
+
+  // Rebuild the level from its live points once half of them are
+  // gone.  The level only becomes smaller, so it stays where it is.
+  if (2*level->n_deleted >= level->n) {
+    int *ids = malloc((level->n - level->n_deleted) * sizeof(int));
+    int n = take_level(forest, l, ids, 0);
+    build_level(forest, l, ids, n);
+  }
+
+  return 0;
+}
+
+// 'dists' is scratch space for 'k' distances.
+static void kdforest_knn_into(const struct kdforest *forest, int k,
+                              const double *query, int *out_ids,
+                              double *dists) {
+  int d = forest->d;
+
+  struct knn_heap heap;
+  knn_heap_init(&heap, k, dists, out_ids);
+
+  // Search the largest trees first, as they are most likely to
+  // contain the neighbours, which then lets us prune the rest.
+  for (int l = MAX_LEVELS-1; l >= 0; l--) {
+    if (forest->levels[l].tree != NULL) {
+      kdtree_knn_heap(forest->levels[l].tree, query, forest->levels[l].ids, &heap);
+    }
+  }
+
+  // The distances here are computed in the same order as within the
+  // trees, so they are exactly the same.
+  for (int i = 0; i < forest->buffer_n; i++) {
+    int id = forest->buffer[i];
+    const double *p = &forest->coords[(size_t)id*d];
+    double dist = 0;
+    for (int j = 0; j < d; j++) {
+      double diff = p[j] - query[j];
+      dist += diff * diff;
+    }
+    if (dist <= knn_heap_radius(&heap)) {
+      knn_heap_push(&heap, dist, id);
+    }
+  }
+
+  knn_heap_sort(&heap);
+}
+
+void kdforest_knn(const struct kdforest *forest, int k, const double *query,
+                  int *out_ids) {
+  double *dists = malloc(k * sizeof(double));
+  kdforest_knn_into(forest, k, query, out_ids, dists);
+  free(dists);
+}
+
+void kdforest_knn_batch(const struct kdforest *forest, int k,
+                        int nq, const double *queries, int *out_ids) {
+  int d = forest->d;
+
+#pragma omp parallel
+  {
+    double *dists = malloc(k * sizeof(double));
+
+#pragma omp for schedule(dynamic, 64)
+    for (int q = 0; q < nq; q++) {
+      kdforest_knn_into(forest, k, &queries[(size_t)q*d],
+                        &out_ids[(size_t)q*k], dists);
+    }
+
+    free(dists);
+  }
+}
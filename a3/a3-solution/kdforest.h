@@ -0,0 +1,56 @@
+#ifndef KDFOREST_H
+#define KDFOREST_H
+
+// A k-d tree that supports inserting and deleting points.
+//
+// A 'struct kdtree' cannot be modified once built, and rebuilding it
+// takes time proportional to the number of points.  The forest uses
+// the logarithmic method instead: it keeps a small buffer of recently
+// inserted points, plus a number of static trees where tree 'l' has
+// room for BUFFER_SIZE*2^l points.  When the buffer is full, it is
+// merged with the smallest trees into a single new tree, much like
+// incrementing a binary counter.  Each point is thus rebuilt into a
+// larger tree at most log(n) times, so an insertion costs amortised
+// O(log² n) time, while a query searches O(log n) trees.
+//
+// Deleted points are only marked as such, and a tree is rebuilt
+// without its deleted points once they make up half of it.
+//
+// Points are identified by the integer that kdforest_insert() returns.
+// The identifier of a deleted point is reused by a later insertion, so
+// identifiers stay below the largest number of points the forest has
+// held at once, and so does the memory used for the copies of the
+// points.  An identifier must not be used after deleting its point.
+struct kdforest;
+
+// Create an empty forest of 'd'-dimensional points.
+struct kdforest *kdforest_create(int d);
+
+// Free a forest.  The pointer must not be used again.
+void kdforest_free(struct kdforest *forest);
+
+// The number of points that have been inserted and not deleted.
+int kdforest_size(const struct kdforest *forest);
+
+// Insert a copy of the 'd'-dimensional point 'point', and return its
+// identifier.
+int kdforest_insert(struct kdforest *forest, const double *point);
+
+// Delete the point with the given identifier.  Returns 1 if there is
+// no such point (or it was already deleted), and 0 on success.
+int kdforest_delete(struct kdforest *forest, int id);
+
+// k-nearest-neighbours among the points currently in the forest.  The
+// identifiers of the neighbours are written to 'out_ids', which must
+// have room for 'k' elements, in the same order as kdtree_knn() would
+// return them.  If the forest has fewer than 'k' points, the remaining
+// elements are -1.
+void kdforest_knn(const struct kdforest *forest, int k, const double *query,
+                  int *out_ids);
+
+// k-nearest-neighbours for many queries at once, in parallel, as for
+// kdtree_knn_batch().
+void kdforest_knn_batch(const struct kdforest *forest, int k,
+                        int nq, const double *queries, int *out_ids);
+
+#endif
@@ -0,0 +1,63 @@
+// Benchmark of k-d tree construction and querying on uniformly
+// distributed random points.  This program is linked against both
+// kdtree.o and kdtree_ptr.o (producing kdtree-bench and
+// kdtree-bench-ptr respectively), such that the two tree layouts can
+// be compared on identical workloads.  See the 'bench' rule in the
+// Makefile.
+
+#include "kdtree.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static double* random_points(int n, int d) {
+  double *data = malloc((size_t)n*d*sizeof(double));
+  for (size_t i = 0; i < (size_t)n*d; i++) {
+    data[i] = ((double)rand())/RAND_MAX;
+  }
+  return data;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 5) {
+    fprintf(stderr, "Usage: %s <n> <d> <queries> <k>\n", argv[0]);
+    exit(1);
+  }
+
+  int n = atoi(argv[1]);
+  int d = atoi(argv[2]);
+  int n_queries = atoi(argv[3]);
+  int k = atoi(argv[4]);
+  assert(n > 0 && d > 0 && n_queries > 0 && k > 0 && k <= n);
+
+  // Fixed seed, so both tree layouts see the same points.
+  srand(1);
+  double *points = random_points(n, d);
+  double *queries = random_points(n_queries, d);
+
+  double start = seconds();
+  struct kdtree *tree = kdtree_create(d, n, points);
+  double build = seconds() - start;
+
+  // Sum the indexes found so the compiler cannot remove the queries,
+  // and so the two layouts can be checked for agreement.
+  long checksum = 0;
+  start = seconds();
+  for (int q = 0; q < n_queries; q++) {
+    int *closest = kdtree_knn(tree, k, &queries[(size_t)q*d]);
+    for (int i = 0; i < k; i++) {
+      checksum += closest[i];
+    }
+    free(closest);
+  }
+  double query = seconds() - start;
+
+  printf("%s: n=%d d=%d queries=%d k=%d build=%.3fs query=%.3fs (%.2fus/query) checksum=%ld\n",
+         argv[0], n, d, n_queries, k, build, query,
+         query/n_queries*1e6, checksum);
+
+  kdtree_free(tree);
+  free(points);
+  free(queries);
+}
@@ -0,0 +1,801 @@
+// For mmap() and friends.
+#define _POSIX_C_SOURCE 200112L
+
+#include "kdtree.h"
+#include "util.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// The tree is stored implicitly as a perfect binary tree in
+// breadth-first order, like a binary heap: the root is node 0, and the
+// children of node 'i' are nodes '2*i+1' and '2*i+2'.  The first
+// 'n_leaves-1' nodes are internal nodes that split their points at
+// the median, and the remaining 'n_leaves' nodes are leaves.  Each
+// leaf holds a bucket of at most LEAF_SIZE points, which are scanned
+// all at once with sq_distances_soa() instead of one at a time.
+#define LEAF_SIZE 32
+
+struct node {
+  // Points in the left subtree have a coordinate along 'axis' that is
+  // at most 'split', and points in the right subtree have a
+  // coordinate that is at least 'split'.
+  double split;
+
+  // Axis along which this node has been split.
+  int axis;
+};
+
+struct kdtree {
+  int d;
+  int n;
+
+  // Nonzero if the tree was built from single precision points by
+  // kdtree_create_f32().  Then 'points' is really a 'const float*',
+  // and 'coords_f32' is used instead of 'coords'.  The points are
+  // only referenced while the tree is being built.
+  int f32;
+  const void *points;
+
+  // Always a power of two.
+  int n_leaves;
+
+  // 'n_leaves-1' internal nodes in breadth-first order.
+  struct node *nodes;
+
+  // Leaf 'j' contains the points 'leaf_start[j]' to
+  // 'leaf_start[j+1]-1' in the order given by 'perm'.  This array has
+  // 'n_leaves+1' elements.
+  int *leaf_start;
+
+  // 'perm[i]' is the index in 'points' of the 'i'th point when ordered
+  // by leaf.
+  int *perm;
+
+  // Copies of the point coordinates, ordered by leaf.  Each leaf is
+  // stored in struct-of-arrays form: if a leaf starts at point 's' and
+  // contains 'len' points, then coordinate 'j' of its 'i'th point is
+  // at 'coords[s*d + j*len + i]'.
+  double *coords;
+  float *coords_f32;
+
+  // If the tree was produced by kdtree_load(), all the arrays above
+  // point into this mapping, and are not individually allocated.
+  void *map_addr;
+  size_t map_len;
+};
+
+// Subtrees with more points than this are built as separate OpenMP
+// tasks.  Below it, the overhead of a task is not worth it.
+#define TASK_CUTOFF 10000
+
+static void swap_ints(int *x, int *y) {
+  int tmp = *x;
+  *x = *y;
+  *y = tmp;
+}
+
+static double median3(double a, double b, double c) {
+  if (a < b) {
+    return b < c ? b : (a < c ? c : a);
+  } else {
+    return a < c ? a : (b < c ? c : b);
+  }
+}
+
+// Coordinate 'j' of point 'p' in the points the tree is being built
+// from.
+static double point_coord(const struct kdtree *tree, int p, int j) {
+  size_t i = (size_t)p*tree->d+j;
+  return tree->f32
+    ? ((const float*)tree->points)[i]
+    : ((const double*)tree->points)[i];
+}
+
+// Reorder 'perm[lo]' to 'perm[hi-1]' such that 'perm[m]' is the point
+// that would be there if the range was sorted by coordinate 'axis',
+// all points before it have a coordinate that is at most as large, and
+// all points after it have a coordinate that is at least as large.
+// This is quickselect (as in C++'s nth_element), which takes expected
+// linear time, rather than a full sort.
+static void select_nth(const struct kdtree *tree, int axis,
+                       int *perm, int lo, int hi, int m) {
+  while (hi - lo > 1) {
+    double pivot = median3(point_coord(tree, perm[lo], axis),
+                           point_coord(tree, perm[lo+(hi-lo)/2], axis),
+                           point_coord(tree, perm[hi-1], axis));
+
+    // Three-way partition into [lo,lt) below the pivot, [lt,gt) equal
+    // to the pivot, and [gt,hi) above the pivot.  Keeping the equal
+    // elements apart means many duplicates cannot make us loop.
+    int lt = lo, i = lo, gt = hi;
+    while (i < gt) {
+      double x = point_coord(tree, perm[i], axis);
+      if (x < pivot) {
+        swap_ints(&perm[lt++], &perm[i++]);
+      } else if (x > pivot) {
+        swap_ints(&perm[i], &perm[--gt]);
+      } else {
+        i++;
+      }
+    }
+
+    if (m < lt) {
+      hi = lt;
+    } else if (m >= gt) {
+      lo = gt;
+    } else {
+      return;
+    }
+  }
+}
+
+static void kdtree_create_node(struct kdtree *tree, int i,
+                               int depth, int lo, int hi) {
+  int d = tree->d;
+
+  if (i >= tree->n_leaves-1) {
+    // Leaf: copy the coordinates into struct-of-arrays form.
+    int leaf = i - (tree->n_leaves-1);
+    int len = hi - lo;
+    tree->leaf_start[leaf] = lo;
+    for (int p = 0; p < len; p++) {
+      for (int j = 0; j < d; j++) {
+        double x = point_coord(tree, tree->perm[lo+p], j);
+        if (tree->f32) {
+          tree->coords_f32[(size_t)lo*d + j*len+p] = x;
+        } else {
+          tree->coords[(size_t)lo*d + j*len+p] = x;
+        }
+      }
+    }
+    return;
+  }
+
+  int axis = depth % d;
+  int m = lo + (hi-lo)/2;
+  select_nth(tree, axis, tree->perm, lo, hi, m);
+
+  tree->nodes[i].axis = axis;
+  tree->nodes[i].split = point_coord(tree, tree->perm[m], axis);
+
+  // The two subtrees touch disjoint parts of every array, so they can
+  // be built in parallel.  The implicit barrier at the end of the
+  // parallel region in kdtree_create() waits for all tasks.
+#pragma omp task if(hi-lo > TASK_CUTOFF)
+  kdtree_create_node(tree, 2*i+1, depth+1, lo, m);
+  kdtree_create_node(tree, 2*i+2, depth+1, m, hi);
+}
+
+// Double the number of leaves until none of them has more than
+// LEAF_SIZE points.  As we split at the median, all leaves then have
+// at least LEAF_SIZE/2 points (unless 'n' itself is smaller).
+static int leaf_count(int n) {
+  int n_leaves = 1;
+  while ((n + n_leaves - 1) / n_leaves > LEAF_SIZE) {
+    n_leaves *= 2;
+  }
+  return n_leaves;
+}
+
+static struct kdtree *kdtree_create_typed(int d, int n, int f32, const void *points) {
+  struct kdtree *tree = malloc(sizeof(struct kdtree));
+  tree->d = d;
+  tree->n = n;
+  tree->f32 = f32;
+  tree->points = points;
+
+  tree->n_leaves = leaf_count(n);
+
+  tree->map_addr = NULL;
+  tree->map_len = 0;
+
+  // Zeroed, such that the padding in the nodes is deterministic when
+  // the tree is saved with kdtree_save().
+  tree->nodes = calloc(tree->n_leaves-1, sizeof(struct node));
+  tree->leaf_start = malloc((tree->n_leaves+1) * sizeof(int));
+  tree->perm = malloc(n * sizeof(int));
+  if (f32) {
+    tree->coords = NULL;
+    tree->coords_f32 = malloc((size_t)n * d * sizeof(float));
+  } else {
+    tree->coords = malloc((size_t)n * d * sizeof(double));
+    tree->coords_f32 = NULL;
+  }
+
+  tree->leaf_start[tree->n_leaves] = n;
+
+#pragma omp parallel
+  {
+#pragma omp for
+    for (int i = 0; i < n; i++) {
+      tree->perm[i] = i;
+    }
+
+#pragma omp single
+    kdtree_create_node(tree, 0, 0, 0, n);
+  }
+
+  // The tree has its own copy of the coordinates, so the points are
+  // not needed any more.
+  tree->points = NULL;
+
+  return tree;
+}
+
+struct kdtree *kdtree_create(int d, int n, const double *points) {
+  return kdtree_create_typed(d, n, 0, points);
+}
+
+struct kdtree *kdtree_create_f32(int d, int n, const float *points) {
+  return kdtree_create_typed(d, n, 1, points);
+}
+
+void kdtree_free(struct kdtree *tree) {
+  if (tree->map_addr != NULL) {
+    munmap(tree->map_addr, tree->map_len);
+  } else {
+    free(tree->nodes);
+    free(tree->leaf_start);
+    free(tree->perm);
+    free(tree->coords);
+    free(tree->coords_f32);
+  }
+  free(tree);
+}
+
+// The on-disk format written by kdtree_save() is this header,
+// followed by the arrays of the tree exactly as they are laid out in
+// memory, each starting at an offset (from the beginning of the file)
+// that is a multiple of 8.  This means kdtree_load() can use the
+// arrays straight from a mapping of the file.  The format is only
+// portable between machines with the same endianness and struct
+// layout.
+#define KDTREE_MAGIC "HPPSKDT"
+#define KDTREE_VERSION 2
+
+struct kdtree_header {
+  char magic[8];
+  uint32_t version;
+  int32_t d;
+  int32_t n;
+  int32_t n_leaves;
+  // Size of each coordinate: 8 for doubles, and 4 for floats.
+  int32_t coord_size;
+  int32_t unused;
+  uint64_t nodes_offset;
+  uint64_t leaf_start_offset;
+  uint64_t perm_offset;
+  uint64_t coords_offset;
+  uint64_t size;
+};
+
+static uint64_t align8(uint64_t x) {
+  return (x + 7) & ~(uint64_t)7;
+}
+
+// Compute the header (including section offsets) for a tree of the
+// given shape.
+static struct kdtree_header kdtree_mk_header(int d, int n, int n_leaves,
+                                             int coord_size) {
+  struct kdtree_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, KDTREE_MAGIC, sizeof(KDTREE_MAGIC));
+  h.version = KDTREE_VERSION;
+  h.d = d;
+  h.n = n;
+  h.n_leaves = n_leaves;
+  h.coord_size = coord_size;
+  h.nodes_offset = align8(sizeof(struct kdtree_header));
+  h.leaf_start_offset = align8(h.nodes_offset + (uint64_t)(n_leaves-1)*sizeof(struct node));
+  h.perm_offset = align8(h.leaf_start_offset + (uint64_t)(n_leaves+1)*sizeof(int));
+  h.coords_offset = align8(h.perm_offset + (uint64_t)n*sizeof(int));
+  h.size = h.coords_offset + (uint64_t)n*d*coord_size;
+  return h;
+}
+
+// Write 'size' bytes from 'data', and then pad with zeroes until the
+// file position is 'end'.
+static int write_section(FILE *f, const void *data, size_t size, uint64_t end) {
+  if (size > 0 && fwrite(data, size, 1, f) != 1) {
+    return 1;
+  }
+  while ((uint64_t)ftell(f) < end) {
+    if (fputc(0, f) == EOF) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int kdtree_save(const struct kdtree *tree, FILE *f) {
+  int d = tree->d, n = tree->n, n_leaves = tree->n_leaves;
+  int coord_size = tree->f32 ? sizeof(float) : sizeof(double);
+  struct kdtree_header h = kdtree_mk_header(d, n, n_leaves, coord_size);
+
+  if (write_section(f, &h, sizeof(h), h.nodes_offset) ||
+      write_section(f, tree->nodes, (size_t)(n_leaves-1)*sizeof(struct node),
+                    h.leaf_start_offset) ||
+      write_section(f, tree->leaf_start, (size_t)(n_leaves+1)*sizeof(int),
+                    h.perm_offset) ||
+      write_section(f, tree->perm, (size_t)n*sizeof(int),
+                    h.coords_offset) ||
+      write_section(f, tree->f32 ? (void*)tree->coords_f32 : (void*)tree->coords,
+                    (size_t)n*d*coord_size, h.size)) {
+    return 1;
+  }
+
+  return 0;
+}
+
+struct kdtree *kdtree_load(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct kdtree_header)) {
+    close(fd);
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Check that the file is what it claims to be by recomputing the
+  // header from the tree dimensions.
+  struct kdtree_header h;
+  memcpy(&h, addr, sizeof(h));
+  struct kdtree_header expected =
+    kdtree_mk_header(h.d, h.n, h.n_leaves, h.coord_size);
+  if (memcmp(&h, &expected, sizeof(h)) != 0 ||
+      (h.coord_size != sizeof(double) && h.coord_size != sizeof(float)) ||
+      h.d < 1 || h.n < 0 || h.n_leaves != leaf_count(h.n) ||
+      (uint64_t)st.st_size < h.size) {
+    munmap(addr, st.st_size);
+    return NULL;
+  }
+
+  unsigned char *base = addr;
+
+  // The searches trust the leaves to fit in their LEAF_SIZE buffers
+  // and the axes to be within the query, so check those too.  This is
+  // cheap next to mapping the file.
+  const struct node *nodes = (const struct node*)(base + h.nodes_offset);
+  const int *leaf_start = (const int*)(base + h.leaf_start_offset);
+  int ok = leaf_start[0] == 0 && leaf_start[h.n_leaves] == h.n;
+  for (int j = 0; ok && j < h.n_leaves; j++) {
+    // By induction, leaf_start[j] >= 0, so this cannot overflow.
+    ok = leaf_start[j+1] >= leaf_start[j] &&
+      leaf_start[j+1] - leaf_start[j] <= LEAF_SIZE;
+  }
+  for (int i = 0; ok && i < h.n_leaves-1; i++) {
+    ok = nodes[i].axis >= 0 && nodes[i].axis < h.d;
+  }
+  if (!ok) {
+    munmap(addr, st.st_size);
+    return NULL;
+  }
+
+  struct kdtree *tree = malloc(sizeof(struct kdtree));
+  tree->d = h.d;
+  tree->n = h.n;
+  tree->f32 = h.coord_size == sizeof(float);
+  tree->points = NULL;
+  tree->n_leaves = h.n_leaves;
+  tree->nodes = (struct node*)(base + h.nodes_offset);
+  tree->leaf_start = (int*)(base + h.leaf_start_offset);
+  tree->perm = (int*)(base + h.perm_offset);
+  tree->coords = tree->f32 ? NULL : (double*)(base + h.coords_offset);
+  tree->coords_f32 = tree->f32 ? (float*)(base + h.coords_offset) : NULL;
+  tree->map_addr = addr;
+  tree->map_len = st.st_size;
+  return tree;
+}
+
+int kdtree_dims(const struct kdtree *tree) {
+  return tree->d;
+}
+
+int kdtree_size(const struct kdtree *tree) {
+  return tree->n;
+}
+
+// The signed distance from the query to the splitting plane of
+// 'node'.  On single precision trees, this is measured from
+// 'query_f32', like the distances to the points in the leaves, as
+// otherwise a query within rounding error of the plane could prune a
+// subtree holding a point that is within the radius.
+static double split_diff(const struct kdtree *tree, const double* query,
+                         const float *query_f32, const struct node *node) {
+  double x = tree->f32 ? query_f32[node->axis] : query[node->axis];
+  return x - node->split;
+}
+
+// Compute the squared distances from the query to the points of a
+// leaf, which are written to 'dists'.  Returns the number of points.
+static int kdtree_leaf_dists(const struct kdtree *tree, const double* query,
+                             const float *query_f32, int leaf, double *dists) {
+  int d = tree->d;
+  int lo = tree->leaf_start[leaf];
+  int len = tree->leaf_start[leaf+1] - lo;
+  if (tree->f32) {
+    sq_distances_soa_f32(d, len, &tree->coords_f32[(size_t)lo*d], query_f32, dists);
+  } else {
+    sq_distances_soa(d, len, &tree->coords[(size_t)lo*d], query, dists);
+  }
+  return len;
+}
+
+// The squared distance within which candidates are still of interest:
+// the heap radius, but never more than 'bound'.
+static double search_radius(const struct knn_heap *heap, double bound) {
+  double radius = knn_heap_radius(heap);
+  return radius < bound ? radius : bound;
+}
+
+// Candidates are collected in 'heap', whose radius is a squared
+// distance.  For single precision trees, 'query_f32' is the query
+// rounded to single precision.  If 'ids' is not NULL, point 'p' is
+// pushed as 'ids[p]', or skipped if that is negative.
+static void kdtree_scan_leaf(const struct kdtree *tree, const double* query,
+                             const float *query_f32, struct knn_heap *heap,
+                             const int *ids, double bound, int leaf) {
+  double dists[LEAF_SIZE];
+  int len = kdtree_leaf_dists(tree, query, query_f32, leaf, dists);
+  const int *perm = &tree->perm[tree->leaf_start[leaf]];
+
+  for (int p = 0; p < len; p++) {
+    if (dists[p] <= search_radius(heap, bound)) {
+      int id = ids == NULL ? perm[p] : ids[perm[p]];
+      if (id >= 0) {
+        knn_heap_push(heap, dists[p], id);
+      }
+    }
+  }
+}
+
+// Only points at squared distance at most 'bound' are considered; this
+// is INFINITY for plain k-NN queries.
+static void kdtree_knn_node(const struct kdtree *tree, const double* query,
+                            const float *query_f32, struct knn_heap *heap,
+                            const int *ids, double bound, int i) {
+  if (i >= tree->n_leaves-1) {
+    kdtree_scan_leaf(tree, query, query_f32, heap, ids, bound, i - (tree->n_leaves-1));
+    return;
+  }
+
+  const struct node *node = &tree->nodes[i];
+  double diff = split_diff(tree, query, query_f32, node);
+  int near = diff < 0 ? 2*i+1 : 2*i+2;
+  int far = diff < 0 ? 2*i+2 : 2*i+1;
+
+  kdtree_knn_node(tree, query, query_f32, heap, ids, bound, near);
+  if (diff*diff <= search_radius(heap, bound)) {
+    kdtree_knn_node(tree, query, query_f32, heap, ids, bound, far);
+  }
+}
+
+void kdtree_knn_heap(const struct kdtree *tree, const double *query,
+                     const int *ids, struct knn_heap *heap) {
+  assert(!tree->f32);
+  kdtree_knn_node(tree, query, NULL, heap, ids, INFINITY, 0);
+}
+
+// Find the neighbours of a single query and write them to 'closest',
+// which must have room for 'k' elements.  'dists' is scratch space for
+// 'k' distances, and 'query_f32' for 'd' floats.  Only neighbours at
+// squared distance at most 'bound' are found.
+static void kdtree_knn_into(const struct kdtree *tree, int k, double bound,
+                            const double* query, int *closest, double *dists,
+                            float *query_f32) {
+  if (tree->f32) {
+    for (int j = 0; j < tree->d; j++) {
+      query_f32[j] = query[j];
+    }
+  }
+
+  struct knn_heap heap;
+  knn_heap_init(&heap, k, dists, closest);
+  kdtree_knn_node(tree, query, query_f32, &heap, NULL, bound, 0);
+  knn_heap_sort(&heap);
+}
+
+int* kdtree_knn(const struct kdtree *tree, int k, const double* query) {
+  int* closest = malloc(k * sizeof(int));
+  double *dists = malloc(k * sizeof(double));
+  float *query_f32 = malloc(tree->d * sizeof(float));
+  kdtree_knn_into(tree, k, INFINITY, query, closest, dists, query_f32);
+  free(query_f32);
+  free(dists);
+  return closest;
+}
+
+static void kdtree_knn_bounded_batch(const struct kdtree *tree, int k, double bound,
+                                     int nq, const double *queries,
+                                     int *out_indexes) {
+  int d = tree->d;
+
+#pragma omp parallel
+  {
+    // Each thread has its own heap storage for distances; the indexes
+    // are kept directly in the output.
+    double *dists = malloc(k * sizeof(double));
+    float *query_f32 = malloc(d * sizeof(float));
+
+    // Query cost varies a lot with how much of the tree has to be
+    // visited, so hand out queries in small chunks.
+#pragma omp for schedule(dynamic, 64)
+    for (int q = 0; q < nq; q++) {
+      kdtree_knn_into(tree, k, bound, &queries[(size_t)q*d],
+                      &out_indexes[(size_t)q*k], dists, query_f32);
+    }
+
+    free(query_f32);
+    free(dists);
+  }
+}
+
+void kdtree_knn_batch(const struct kdtree *tree, int k,
+                      int nq, const double *queries, int *out_indexes) {
+  kdtree_knn_bounded_batch(tree, k, INFINITY, nq, queries, out_indexes);
+}
+
+void kdtree_knn_radius_batch(const struct kdtree *tree, int k, double r,
+                             int nq, const double *queries, int *out_indexes) {
+  kdtree_knn_bounded_batch(tree, k, r*r, nq, queries, out_indexes);
+}
+
+// Range search visits every subtree that the sphere around the query
+// reaches, with the same test on the splitting planes as
+// kdtree_knn_node(), except that the radius is fixed.  If 'matches' is
+// NULL, the points are only counted.
+static int kdtree_radius_node(const struct kdtree *tree, const double *query,
+                              const float *query_f32, double r2,
+                              struct kdtree_matches *matches, int i) {
+  if (i >= tree->n_leaves-1) {
+    int leaf = i - (tree->n_leaves-1);
+    double dists[LEAF_SIZE];
+    int len = kdtree_leaf_dists(tree, query, query_f32, leaf, dists);
+    const int *perm = &tree->perm[tree->leaf_start[leaf]];
+
+    int count = 0;
+    for (int p = 0; p < len; p++) {
+      count += dists[p] <= r2;
+    }
+
+    if (matches != NULL && count > 0) {
+      if (matches->n + count > matches->capacity) {
+        int capacity = matches->capacity == 0 ? 64 : 2*matches->capacity;
+        while (capacity < matches->n + count) {
+          capacity *= 2;
+        }
+        matches->indexes = realloc(matches->indexes, capacity * sizeof(int));
+        matches->capacity = capacity;
+      }
+      for (int p = 0; p < len; p++) {
+        if (dists[p] <= r2) {
+          matches->indexes[matches->n++] = perm[p];
+        }
+      }
+    }
+    return count;
+  }
+
+  const struct node *node = &tree->nodes[i];
+  double diff = split_diff(tree, query, query_f32, node);
+  int near = diff < 0 ? 2*i+1 : 2*i+2;
+  int far = diff < 0 ? 2*i+2 : 2*i+1;
+
+  int count = kdtree_radius_node(tree, query, query_f32, r2, matches, near);
+  if (diff*diff <= r2) {
+    count += kdtree_radius_node(tree, query, query_f32, r2, matches, far);
+  }
+  return count;
+}
+
+static int kdtree_radius(const struct kdtree *tree, double r, const double *query,
+                         struct kdtree_matches *matches) {
+  float *query_f32 = NULL;
+  if (tree->f32) {
+    query_f32 = malloc(tree->d * sizeof(float));
+    for (int j = 0; j < tree->d; j++) {
+      query_f32[j] = query[j];
+    }
+  }
+
+  int count = kdtree_radius_node(tree, query, query_f32, r*r, matches, 0);
+
+  free(query_f32);
+  return count;
+}
+
+void kdtree_radius_search(const struct kdtree *tree, double r, const double *query,
+                          struct kdtree_matches *matches) {
+  matches->n = 0;
+  kdtree_radius(tree, r, query, matches);
+}
+
+int kdtree_radius_count(const struct kdtree *tree, double r, const double *query) {
+  return kdtree_radius(tree, r, query, NULL);
+}
+
+// The approximate search is best-bin-first: rather than backtracking
+// in depth-first order, we keep all the subtrees we have skipped in a
+// priority queue ordered by a lower bound on their distance to the
+// query, and always continue with the closest one.  This finds good
+// candidates early, so stopping after a fixed number of leaves still
+// gives most of the true neighbours.
+//
+// The queue is a binary min-heap that grows as needed, and is reused
+// across queries.
+struct bbf_queue {
+  int size;
+  int capacity;
+  double *bounds;
+  int *nodes;
+};
+
+static void bbf_push(struct bbf_queue *q, double bound, int node) {
+  if (q->size == q->capacity) {
+    q->capacity = q->capacity == 0 ? 64 : 2*q->capacity;
+    q->bounds = realloc(q->bounds, q->capacity * sizeof(double));
+    q->nodes = realloc(q->nodes, q->capacity * sizeof(int));
+  }
+
+  int i = q->size++;
+  while (i > 0 && q->bounds[(i-1)/2] > bound) {
+    q->bounds[i] = q->bounds[(i-1)/2];
+    q->nodes[i] = q->nodes[(i-1)/2];
+    i = (i-1)/2;
+  }
+  q->bounds[i] = bound;
+  q->nodes[i] = node;
+}
+
+// Remove the entry with the smallest bound.  The queue must not be
+// empty.
+static void bbf_pop(struct bbf_queue *q, double *bound, int *node) {
+  *bound = q->bounds[0];
+  *node = q->nodes[0];
+
+  double last_bound = q->bounds[--q->size];
+  int last_node = q->nodes[q->size];
+  int i = 0;
+  while (2*i+1 < q->size) {
+    int c = 2*i+1;
+    if (c+1 < q->size && q->bounds[c+1] < q->bounds[c]) {
+      c++;
+    }
+    if (q->bounds[c] >= last_bound) {
+      break;
+    }
+    q->bounds[i] = q->bounds[c];
+    q->nodes[i] = q->nodes[c];
+    i = c;
+  }
+  q->bounds[i] = last_bound;
+  q->nodes[i] = last_node;
+}
+
+static void kdtree_knn_approx_into(const struct kdtree *tree, int k, int max_leaves,
+                                   const double* query, int *closest,
+                                   double *dists, float *query_f32,
+                                   struct bbf_queue *queue) {
+  if (tree->f32) {
+    for (int j = 0; j < tree->d; j++) {
+      query_f32[j] = query[j];
+    }
+  }
+
+  struct knn_heap heap;
+  knn_heap_init(&heap, k, dists, closest);
+
+  queue->size = 0;
+  bbf_push(queue, 0, 0);
+
+  int visited = 0;
+  while (queue->size > 0 && (max_leaves <= 0 || visited < max_leaves)) {
+    double bound;
+    int i;
+    bbf_pop(queue, &bound, &i);
+
+    // Everything left in the queue is at least this far away, so
+    // nothing can improve the result any more.
+    if (bound > knn_heap_radius(&heap)) {
+      break;
+    }
+
+    // Descend to a leaf, queueing the far side of every split.  A far
+    // subtree is at least as distant as its parent, and at least as
+    // distant as the splitting plane.
+    while (i < tree->n_leaves-1) {
+      const struct node *node = &tree->nodes[i];
+      double diff = split_diff(tree, query, query_f32, node);
+      int near = diff < 0 ? 2*i+1 : 2*i+2;
+      int far = diff < 0 ? 2*i+2 : 2*i+1;
+      double far_bound = diff*diff > bound ? diff*diff : bound;
+      if (far_bound <= knn_heap_radius(&heap)) {
+        bbf_push(queue, far_bound, far);
+      }
+      i = near;
+    }
+
+    kdtree_scan_leaf(tree, query, query_f32, &heap, NULL, INFINITY, i - (tree->n_leaves-1));
+    visited++;
+  }
+
+  knn_heap_sort(&heap);
+}
+
+void kdtree_knn_approx_batch(const struct kdtree *tree, int k, int max_leaves,
+                             int nq, const double *queries, int *out_indexes) {
+  int d = tree->d;
+
+#pragma omp parallel
+  {
+    double *dists = malloc(k * sizeof(double));
+    float *query_f32 = malloc(d * sizeof(float));
+    struct bbf_queue queue = { 0, 0, NULL, NULL };
+
+#pragma omp for schedule(dynamic, 64)
+    for (int q = 0; q < nq; q++) {
+      kdtree_knn_approx_into(tree, k, max_leaves, &queries[(size_t)q*d],
+                             &out_indexes[(size_t)q*k], dists, query_f32,
+                             &queue);
+    }
+
+    free(queue.bounds);
+    free(queue.nodes);
+    free(query_f32);
+    free(dists);
+  }
+}
+
+static void kdtree_svg_node(double scale, FILE *f, const struct kdtree *tree,
+                            double x1, double y1, double x2, double y2,
+                            int i) {
+  if (i >= tree->n_leaves-1) {
+    return;
+  }
+
+  const struct node *node = &tree->nodes[i];
+  double coord = node->split;
+  if (node->axis == 0) {
+    // Split the X axis, so vertical line.
+    fprintf(f, "<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke-width=\"1\" stroke=\"black\" />\n",
+            coord*scale, y1*scale, coord*scale, y2*scale);
+    kdtree_svg_node(scale, f, tree,
+                    x1, y1, coord, y2,
+                    2*i+1);
+    kdtree_svg_node(scale, f, tree,
+                    coord, y1, x2, y2,
+                    2*i+2);
+  } else {
+    // Split the Y axis, so horizontal line.
+    fprintf(f, "<line x1=\"%f\" y1=\"%f\" x2=\"%f\" y2=\"%f\" stroke-width=\"1\" stroke=\"black\" />\n",
+            x1*scale, coord*scale, x2*scale, coord*scale);
+    kdtree_svg_node(scale, f, tree,
+                    x1, y1, x2, coord,
+                    2*i+1);
+    kdtree_svg_node(scale, f, tree,
+                    x1, coord, x2, y2,
+                    2*i+2);
+  }
+}
+
+void kdtree_svg(double scale, FILE* f, const struct kdtree *tree) {
+  assert(tree->d == 2);
+  kdtree_svg_node(scale, f, tree, 0, 0, 1, 1, 0);
+}
@@ -0,0 +1,141 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <stdio.h>
+
+// An opaque struct representing a k-d tree.
+struct kdtree;
+
+// Defined in util.h.
+struct knn_heap;
+
+// Construct a new k-d tree corresponding to points in a space.
+//
+// 'd' is the number of dimensions in the space.
+//
+// 'n' is the number of reference points in the space.
+//
+// 'points' is an 'n'-element array of 'd'-dimensional reference
+// points.  The tree keeps its own copy of the coordinates, so 'points'
+// may be freed once the tree has been created.
+struct kdtree *kdtree_create(int d, int n, const double *points);
+
+// Like kdtree_create(), but for single precision points.  The tree
+// then also stores its copy of the points in single precision, and
+// computes distances in single precision, which halves its memory
+// footprint and bandwidth.  Queries are still given as doubles.
+struct kdtree *kdtree_create_f32(int d, int n, const float *points);
+
+// Free a k-d tree.  The pointer must not be used again.
+void kdtree_free(struct kdtree* tree);
+
+// The number of dimensions of the points in the tree.
+int kdtree_dims(const struct kdtree *tree);
+
+// The number of points in the tree.
+int kdtree_size(const struct kdtree *tree);
+
+// Write the tree to the given file in a binary format that can be read
+// back with kdtree_load().  The reference points themselves are
+// included, so they are not needed to use the loaded tree.  Returns 1
+// on error and 0 on success.
+int kdtree_save(const struct kdtree *tree, FILE *f);
+
+// Load a tree written by kdtree_save().  The file is mapped into
+// memory and used as is, so this takes constant time regardless of
+// the size of the tree, and several processes loading the same file
+// share its memory.  Returns NULL if the file cannot be read or is
+// not a tree in the current format.  The tree must be freed with
+// kdtree_free() as usual.
+struct kdtree *kdtree_load(const char *filename);
+
+// k-d tree-accelerated k-nearest-neighbours.
+//
+// 'tree' is a k-d tree produced by kdtree_create().
+//
+// 'k' is the number of neighbours to find.
+//
+// 'query' is the query point that we are finding neighbours for.  It
+// is assumed to have the same number of dimensions as the space that
+// was used to construct 'tree'.
+//
+// Returns a freshly allocated 'k'-element array that contains the
+// indexes of the nearest neighbours to 'query' in 'points'.  It is
+// the responsibility of the caller to free this array.
+int* kdtree_knn(const struct kdtree *tree, int k, const double* query);
+
+// k-d tree-accelerated k-nearest-neighbours for many queries at once.
+//
+// 'nq' is the number of queries, and 'queries' is an 'nq'-element
+// array of query points.
+//
+// The indexes of the 'k' nearest neighbours of query 'q' are written
+// to 'out_indexes[q*k]' through 'out_indexes[q*k+k-1]', in the same
+// order as kdtree_knn() would return them.  The caller must provide
+// room for 'nq*k' elements.
+//
+// The queries are processed in parallel with OpenMP, and nothing is
+// allocated per query.
+void kdtree_knn_batch(const struct kdtree *tree, int k,
+                      int nq, const double *queries, int *out_indexes);
+
+// Offer the points of the tree to a heap of candidates, which may
+// already contain points from elsewhere.  This is how several trees
+// are searched together (see kdforest.h): points that are not closer
+// than what the heap already holds are never visited.
+//
+// Point 'i' of the tree is pushed with index 'ids[i]', or skipped if
+// 'ids[i]' is negative.  The tree must not be single precision.
+void kdtree_knn_heap(const struct kdtree *tree, const double *query,
+                     const int *ids, struct knn_heap *heap);
+
+// Approximate k-nearest-neighbours for many queries at once.  This is
+// like kdtree_knn_batch(), but visits at most 'max_leaves' leaves of
+// the tree (each holding a few dozen points) per query, in order of
+// how promising they are.  The result is the best neighbours found
+// among the points visited, so some true neighbours may be missing.
+//
+// 'max_leaves' trades accuracy for speed: a small budget is fast but
+// has lower recall, and the search becomes exact (but slower than
+// kdtree_knn_batch()) as the budget grows.  If 'max_leaves' is zero
+// or negative, there is no budget and the search is exact.
+void kdtree_knn_approx_batch(const struct kdtree *tree, int k, int max_leaves,
+                             int nq, const double *queries, int *out_indexes);
+
+// Like kdtree_knn_batch(), but only finds neighbours at distance at
+// most 'r' from the query.  If there are fewer than 'k' of these, the
+// remaining indexes are -1.
+void kdtree_knn_radius_batch(const struct kdtree *tree, int k, double r,
+                             int nq, const double *queries, int *out_indexes);
+
+// The result of a range search: 'n' indexes of points, stored in
+// 'indexes', which has room for 'capacity' elements.
+//
+// The buffer belongs to the caller, and is grown with realloc() as
+// needed, so the same buffer can be reused for many queries without
+// allocating.  Initialise it as
+//
+//   struct kdtree_matches matches = { 0, 0, NULL };
+//
+// and free 'matches.indexes' when done.
+struct kdtree_matches {
+  int n;
+  int capacity;
+  int *indexes;
+};
+
+// Find all points at distance at most 'r' from 'query', and store
+// their indexes in 'matches', replacing its previous contents.  The
+// indexes are in no particular order.
+void kdtree_radius_search(const struct kdtree *tree, double r, const double *query,
+                          struct kdtree_matches *matches);
+
+// Count the points at distance at most 'r' from 'query'.  This is
+// like kdtree_radius_search(), but does not store the indexes.
+int kdtree_radius_count(const struct kdtree *tree, double r, const double *query);
+
+// Print an SVG representation of the tree to the given file, scaling
+// up point coordinates as indicated.
+void kdtree_svg(double scale, FILE* f, const struct kdtree *tree);
+
+#endif
@@ -0,0 +1,154 @@
+// Benchmark of brute force against the k-d tree for one combination
+// of distribution, n, d and k, printed as CSV so that many runs can be
+// collected into one table.  The number of threads is controlled with
+// OMP_NUM_THREADS; see the 'bench-knn' rule in the Makefile, which
+// sweeps all the parameters.
+//
+// The distributions are
+//
+//   uniform    Coordinates uniform in [0,1).
+//
+//   clustered  Gaussian clusters of equal size and spread around
+//              CLUSTERS centres that are uniform in [0,1)^d.
+//
+//   skew       Like clustered, but cluster 'j' is chosen with
+//              probability proportional to 1/(j+1), and the larger
+//              a cluster, the denser it is.  Real data (cities,
+//              customers, documents) tends to look like this.
+//
+// Queries are drawn from the same distribution as the points.  Brute
+// force has no build phase, so its build time is always 0.  The two
+// engines must find the same neighbours, or the program fails.
+
+#include "bruteforce.h"
+#include "kdtree.h"
+#include "prng.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <omp.h>
+
+#define TWO_PI 6.28318530717958647692
+
+#define CLUSTERS 64
+#define CLUSTER_SPREAD 0.02
+
+enum distribution { UNIFORM, CLUSTERED, SKEW };
+
+static const char *distribution_names[] = { "uniform", "clustered", "skew" };
+
+// A standard normal sample, by the Box-Muller transform.
+static double gaussian(struct prng *r) {
+  double u[2];
+  prng_doubles(r, u, 2);
+  return sqrt(-2 * log(1 - u[0])) * cos(TWO_PI * u[1]);
+}
+
+// 'n' points from distribution 'dist'.  The cluster centres only
+// depend on 'd', so points and queries generated with different seeds
+// share them.
+static double* random_points(enum distribution dist, int n, int d, uint64_t seed) {
+  double *data = malloc((size_t)n*d*sizeof(double));
+  struct prng r;
+
+  if (dist == UNIFORM) {
+    prng_seed(&r, seed);
+    prng_doubles(&r, data, (size_t)n*d);
+    return data;
+  }
+
+  double *centres = malloc(CLUSTERS*d*sizeof(double));
+  prng_seed(&r, 0);
+  prng_doubles(&r, centres, CLUSTERS*d);
+
+  // Cumulative probabilities of choosing each cluster.
+  double cumulative[CLUSTERS];
+  double total = 0;
+  for (int j = 0; j < CLUSTERS; j++) {
+    total += dist == SKEW ? 1.0/(j+1) : 1;
+    cumulative[j] = total;
+  }
+
+  prng_seed(&r, seed);
+  for (int i = 0; i < n; i++) {
+    double u;
+    prng_doubles(&r, &u, 1);
+    int j = 0;
+    while (j < CLUSTERS-1 && cumulative[j] < u*total) {
+      j++;
+    }
+    double spread = dist == SKEW ? CLUSTER_SPREAD * (j+1) / CLUSTERS : CLUSTER_SPREAD;
+    for (int c = 0; c < d; c++) {
+      data[(size_t)i*d+c] = centres[j*d+c] + spread * gaussian(&r);
+    }
+  }
+
+  free(centres);
+  return data;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 2 && strcmp(argv[1], "--header") == 0) {
+    printf("distribution,n,d,queries,k,threads,engine,build_s,query_s,us_per_query\n");
+    return 0;
+  }
+  if (argc != 6) {
+    fprintf(stderr, "Usage: %s --header\n", argv[0]);
+    fprintf(stderr, "       %s <uniform|clustered|skew> <n> <d> <queries> <k>\n", argv[0]);
+    exit(1);
+  }
+
+  int dist = -1;
+  for (int i = 0; i < 3; i++) {
+    if (strcmp(argv[1], distribution_names[i]) == 0) {
+      dist = i;
+    }
+  }
+  int n = atoi(argv[2]);
+  int d = atoi(argv[3]);
+  int n_queries = atoi(argv[4]);
+  int k = atoi(argv[5]);
+  assert(dist >= 0);
+  assert(n > 0 && d > 0 && n_queries > 0 && k > 0 && k <= n);
+
+  double *points = random_points(dist, n, d, 1);
+  double *queries = random_points(dist, n_queries, d, 2);
+  int *indexes_brute = malloc((size_t)n_queries*k*sizeof(int));
+  int *indexes_tree = malloc((size_t)n_queries*k*sizeof(int));
+  int threads = omp_get_max_threads();
+
+  double start = seconds();
+  knn_batch(k, d, n, points, n_queries, queries, indexes_brute);
+  double brute_query = seconds() - start;
+
+  start = seconds();
+  struct kdtree *tree = kdtree_create(d, n, points);
+  double tree_build = seconds() - start;
+
+  start = seconds();
+  kdtree_knn_batch(tree, k, n_queries, queries, indexes_tree);
+  double tree_query = seconds() - start;
+
+  printf("%s,%d,%d,%d,%d,%d,bruteforce,%.6f,%.6f,%.3f\n",
+         argv[1], n, d, n_queries, k, threads,
+         0.0, brute_query, brute_query/n_queries*1e6);
+  printf("%s,%d,%d,%d,%d,%d,kdtree,%.6f,%.6f,%.3f\n",
+         argv[1], n, d, n_queries, k, threads,
+         tree_build, tree_query, tree_query/n_queries*1e6);
+
+  int ok = memcmp(indexes_brute, indexes_tree, (size_t)n_queries*k*sizeof(int)) == 0;
+  if (!ok) {
+    fprintf(stderr, "%s: brute force and k-d tree disagree\n", argv[0]);
+  }
+
+  kdtree_free(tree);
+  free(indexes_tree);
+  free(indexes_brute);
+  free(queries);
+  free(points);
+
+  return !ok;
+}
@@ -0,0 +1,114 @@
+#include "io.h"
+#include "outbuf.h"
+#include "bruteforce.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--quiet] [--direct] <points> <queries> <k> [output-file]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  // With --quiet, the indexes are not printed, and with --direct, the
+  // output file is written with O_DIRECT.
+  int quiet = 0;
+  int direct = 0;
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--quiet") == 0) {
+      quiet = 1;
+    } else if (strcmp(argv[argi], "--direct") == 0) {
+      direct = 1;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  int n_args = argc - argi;
+  if (n_args != 3 && n_args != 4) {
+    usage(argv[0]);
+  }
+  const char *points_fname = argv[argi];
+  const char *queries_fname = argv[argi+1];
+  int32_t k = atoi(argv[argi+2]);
+  const char *output_fname = n_args == 4 ? argv[argi+3] : NULL;
+
+  int n_points = -1;
+  int d;
+  enum point_type type;
+  struct file_map points_map;
+  const void* points = map_points_typed(points_fname, ACCESS_SEQUENTIAL,
+                                        &n_points, &d, &type, &points_map);
+  if (points == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", points_fname);
+    exit(1);
+  }
+
+  int n_queries = -1;
+  int d_queries;
+  struct file_map queries_map;
+  const double* queries = map_points(queries_fname, ACCESS_SEQUENTIAL,
+                                     &n_queries, &d_queries, &queries_map);
+  if (queries == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", queries_fname);
+    exit(1);
+  }
+
+  if (d != d_queries) {
+    fprintf(stderr, "Reference points have %d dimensions, but query points have %d dimensions\n",
+            (int)d, (int)d_queries);
+    exit(1);
+  }
+
+  printf("Dimensions: %d\n", (int)d);
+  printf("Points: %d (%s)\n", n_points, type == POINT_F32 ? "float32" : "float64");
+  printf("Queries: %d\n", n_queries);
+  printf("Finding indexes of %d nearest neighbours\n", k);
+
+  int* indexes = malloc((size_t)n_queries*k*sizeof(int));
+
+  double start = seconds();
+  if (type == POINT_F32) {
+    knn_batch_f32(k, d, n_points, points, n_queries, queries, indexes);
+  } else {
+    knn_batch(k, d, n_points, points, n_queries, queries, indexes);
+  }
+  printf("Running queries: %.3fs\n", seconds()-start);
+
+  // The text goes through an outbuf on the same descriptor as
+  // printf(), so anything printf() has buffered must go first.
+  fflush(stdout);
+  if (!quiet) {
+    struct outbuf out;
+    int err = outbuf_fd(&out, STDOUT_FILENO);
+    assert(err == 0);
+    print_indexes(&out, n_queries, k, indexes);
+    err = outbuf_close(&out);
+    assert(err == 0);
+  }
+
+  if (output_fname != NULL) {
+    struct outbuf out;
+    if (outbuf_open(&out, output_fname, direct) != 0) {
+      fprintf(stderr, "Failed opening %s\n", output_fname);
+      exit(1);
+    }
+    write_indexes_buf(&out, n_queries, k, indexes);
+    if (outbuf_close(&out) != 0) {
+      fprintf(stderr, "Failed writing %s\n", output_fname);
+      exit(1);
+    }
+  }
+
+  free(indexes);
+  unmap_file(&points_map);
+  unmap_file(&queries_map);
+
+  return 0;
+}
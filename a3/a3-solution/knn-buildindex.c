@@ -0,0 +1,52 @@
+#include "io.h"
+#include "kdtree.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+// Build a tree in the precision of the points file.
+static struct kdtree *create_tree(int d, int n, enum point_type type,
+                                  const void *points) {
+  if (type == POINT_F32) {
+    return kdtree_create_f32(d, n, points);
+  } else {
+    return kdtree_create(d, n, points);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s <points> <index-file>\n", argv[0]);
+    exit(1);
+  }
+
+  int n_points = -1;
+  int d;
+  enum point_type type;
+  struct file_map points_map;
+  const void* points = map_points_typed(argv[1], ACCESS_NORMAL,
+                                        &n_points, &d, &type, &points_map);
+  if (points == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", argv[1]);
+    exit(1);
+  }
+
+  double start = seconds();
+  struct kdtree *kdtree = create_tree(d, n_points, type, points);
+  printf("Building tree: %.3fs\n", seconds()-start);
+
+  FILE *output_f = fopen(argv[2], "w");
+  assert(output_f != NULL);
+
+  start = seconds();
+  int err = kdtree_save(kdtree, output_f);
+  assert(err == 0);
+  fclose(output_f);
+  printf("Writing index: %.3fs\n", seconds()-start);
+
+  kdtree_free(kdtree);
+  unmap_file(&points_map);
+
+  return 0;
+}
@@ -0,0 +1,106 @@
+// Generate random points with coordinates uniformly distributed in
+// [0,1).
+//
+// The points are generated in chunks of about CHUNK_VALUES
+// coordinates, several chunks at a time in parallel, and each batch of
+// chunks is written out before the next is generated, so memory use
+// does not depend on the number of points.  Chunk 'i' is generated
+// from the random stream obtained by jumping 'i' times from the seed,
+// so the output depends only on the seed, and not on the number of
+// threads.
+
+#include "io.h"
+#include "prng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+#include <string.h>
+#include <omp.h>
+
+#define CHUNK_VALUES (1<<20)
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--float32] [--seed <seed>] <n> <d>\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  // With --float32, write single precision coordinates.
+  int f32 = 0;
+  int have_seed = 0;
+  uint64_t seed = 0;
+
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--float32") == 0) {
+      f32 = 1;
+    } else if (strcmp(argv[argi], "--seed") == 0 && argi+1 < argc) {
+      seed = strtoull(argv[++argi], NULL, 10);
+      have_seed = 1;
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (argc - argi != 2) {
+    usage(argv[0]);
+  }
+
+  int32_t n = atoi(argv[argi]);
+  int32_t d = atoi(argv[argi+1]);
+  assert(n >= 0 && d > 0);
+
+  if (!have_seed) {
+    seed = time(NULL) ^ d ^ n;
+  }
+
+  int err = write_points_header(stdout, n, d, f32 ? POINT_F32 : POINT_F64);
+  assert(err == 0);
+
+  int threads = omp_get_max_threads();
+  long chunk_points = CHUNK_VALUES / d > 0 ? CHUNK_VALUES / d : 1;
+  long n_chunks = (n + chunk_points - 1) / chunk_points;
+  size_t chunk_values = (size_t)chunk_points * d;
+
+  double *data = f32 ? NULL : malloc(threads * chunk_values * sizeof(double));
+  float *data_f32 = f32 ? malloc(threads * chunk_values * sizeof(float)) : NULL;
+  struct prng *streams = malloc(threads * sizeof(struct prng));
+
+  struct prng stream;
+  prng_seed(&stream, seed);
+
+  for (long first = 0; first < n_chunks; first += threads) {
+    int m = n_chunks - first < threads ? n_chunks - first : threads;
+    for (int t = 0; t < m; t++) {
+      streams[t] = stream;
+      prng_jump(&stream);
+    }
+
+    // The last chunk may be partial.
+    long start = first * chunk_points;
+    long count = n - start < m * chunk_points ? n - start : m * chunk_points;
+
+#pragma omp parallel for
+    for (int t = 0; t < m; t++) {
+      long lo = t * chunk_points;
+      long hi = lo + chunk_points < count ? lo + chunk_points : count;
+      if (f32) {
+        prng_floats(&streams[t], &data_f32[lo*d], (hi-lo) * d);
+      } else {
+        prng_doubles(&streams[t], &data[lo*d], (hi-lo) * d);
+      }
+    }
+
+    if (f32) {
+      err = fwrite(data_f32, d*sizeof(float), count, stdout) != (size_t)count;
+    } else {
+      err = fwrite(data, d*sizeof(double), count, stdout) != (size_t)count;
+    }
+    assert(err == 0);
+  }
+
+  free(streams);
+  free(data_f32);
+  free(data);
+}
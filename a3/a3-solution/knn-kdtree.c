@@ -0,0 +1,182 @@
+#include "io.h"
+#include "outbuf.h"
+#include "kdtree.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+#include <unistd.h>
+
+// Build a tree in the precision of the points file.
+static struct kdtree *create_tree(int d, int n, enum point_type type,
+                                  const void *points) {
+  if (type == POINT_F32) {
+    return kdtree_create_f32(d, n, points);
+  } else {
+    return kdtree_create(d, n, points);
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--quiet] [--direct] [--build-speedup] [--index <index-file>] [--approx <max-leaves> | --radius <r>] <points> <queries> <k> [output-file]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  // Options come before the positional arguments.  With --quiet, the
+  // indexes are not printed, and with --direct, the output file is
+  // written with O_DIRECT.
+  int build_speedup = 0;
+  int quiet = 0;
+  int direct = 0;
+  const char *index_fname = NULL;
+  int max_leaves = -1;
+  double radius = -1;
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--build-speedup") == 0) {
+      build_speedup = 1;
+    } else if (strcmp(argv[argi], "--quiet") == 0) {
+      quiet = 1;
+    } else if (strcmp(argv[argi], "--direct") == 0) {
+      direct = 1;
+    } else if (strcmp(argv[argi], "--index") == 0 && argi+1 < argc) {
+      index_fname = argv[++argi];
+    } else if (strcmp(argv[argi], "--approx") == 0 && argi+1 < argc) {
+      max_leaves = atoi(argv[++argi]);
+    } else if (strcmp(argv[argi], "--radius") == 0 && argi+1 < argc) {
+      radius = atof(argv[++argi]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  int n_args = argc - argi;
+  if ((n_args != 3 && n_args != 4) || (max_leaves >= 0 && radius >= 0)) {
+    usage(argv[0]);
+  }
+  const char *points_fname = argv[argi];
+  const char *queries_fname = argv[argi+1];
+  int32_t k = atoi(argv[argi+2]);
+  const char *output_fname = n_args == 4 ? argv[argi+3] : NULL;
+
+  int n_points = -1;
+  int d;
+  enum point_type type;
+  struct file_map points_map;
+  const void* points = map_points_typed(points_fname, ACCESS_NORMAL,
+                                        &n_points, &d, &type, &points_map);
+  if (points == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", points_fname);
+    exit(1);
+  }
+
+  int n_queries = -1;
+  int d_queries;
+  struct file_map queries_map;
+  const double* queries = map_points(queries_fname, ACCESS_SEQUENTIAL,
+                                     &n_queries, &d_queries, &queries_map);
+  if (queries == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", queries_fname);
+    exit(1);
+  }
+
+  if (d != d_queries) {
+    fprintf(stderr, "Reference points have dimensionality %d, but query points have dimensionality %d\n",
+            (int)d, (int)d_queries);
+    exit(1);
+  }
+
+  printf("Dimensions: %d\n", (int)d);
+  printf("Points: %d (%s)\n", n_points, type == POINT_F32 ? "float32" : "float64");
+  printf("Queries: %d\n", n_queries);
+  printf("Finding indexes of %d nearest neighbours\n", k);
+
+  struct kdtree *kdtree;
+  if (index_fname != NULL) {
+    // Use a tree prebuilt by knn-buildindex.
+    double start = seconds();
+    kdtree = kdtree_load(index_fname);
+    if (kdtree == NULL) {
+      fprintf(stderr, "Failed reading index from %s\n", index_fname);
+      exit(1);
+    }
+    if (kdtree_dims(kdtree) != d || kdtree_size(kdtree) != n_points) {
+      fprintf(stderr, "Index %s does not match %s\n", index_fname, points_fname);
+      exit(1);
+    }
+    printf("Loading index: %.3fs\n", seconds()-start);
+  } else {
+    // Optionally build the tree once on a single thread first, to find
+    // out how much the parallel build gains.
+    int threads = omp_get_max_threads();
+    double sequential = 0;
+    if (build_speedup) {
+      omp_set_num_threads(1);
+      double start = seconds();
+      kdtree_free(create_tree(d, n_points, type, points));
+      sequential = seconds()-start;
+      omp_set_num_threads(threads);
+    }
+
+    double start = seconds();
+    kdtree = create_tree(d, n_points, type, points);
+    double build = seconds()-start;
+    printf("Building tree: %.3fs (%d threads)\n", build, threads);
+    if (build_speedup) {
+      printf("Building tree sequentially: %.3fs (speedup: %.2fx)\n",
+             sequential, sequential/build);
+    }
+  }
+
+  int* indexes = malloc((size_t)n_queries*k*sizeof(int));
+
+  double start = seconds();
+  if (radius >= 0) {
+    kdtree_knn_radius_batch(kdtree, k, radius, n_queries, queries, indexes);
+    printf("Running queries within radius %g: %.3fs\n", radius, seconds()-start);
+  } else if (max_leaves >= 0) {
+    kdtree_knn_approx_batch(kdtree, k, max_leaves, n_queries, queries, indexes);
+    printf("Running approximate queries (at most %d leaves): %.3fs\n",
+           max_leaves, seconds()-start);
+  } else {
+    kdtree_knn_batch(kdtree, k, n_queries, queries, indexes);
+    printf("Running queries: %.3fs\n", seconds()-start);
+  }
+
+  // The text goes through an outbuf on the same descriptor as
+  // printf(), so anything printf() has buffered must go first.
+  fflush(stdout);
+  if (!quiet) {
+    struct outbuf out;
+    int err = outbuf_fd(&out, STDOUT_FILENO);
+    assert(err == 0);
+    print_indexes(&out, n_queries, k, indexes);
+    err = outbuf_close(&out);
+    assert(err == 0);
+  }
+
+  if (output_fname != NULL) {
+    struct outbuf out;
+    if (outbuf_open(&out, output_fname, direct) != 0) {
+      fprintf(stderr, "Failed opening %s\n", output_fname);
+      exit(1);
+    }
+    write_indexes_buf(&out, n_queries, k, indexes);
+    if (outbuf_close(&out) != 0) {
+      fprintf(stderr, "Failed writing %s\n", output_fname);
+      exit(1);
+    }
+  }
+
+  kdtree_free(kdtree);
+
+  free(indexes);
+  unmap_file(&points_map);
+  unmap_file(&queries_map);
+
+  return 0;
+}
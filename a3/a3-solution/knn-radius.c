@@ -0,0 +1,93 @@
+#include "io.h"
+#include "kdtree.h"
+#include "sort.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+int main(int argc, char** argv) {
+  // With --count, only the number of points within the radius is
+  // printed for each query.
+  int count_only = argc == 5 && strcmp(argv[1], "--count") == 0;
+
+  if (argc != 4 && !count_only) {
+    fprintf(stderr, "Usage: %s [--count] <points> <queries> <r>\n", argv[0]);
+    exit(1);
+  }
+
+  const char *points_fname = argv[argc-3];
+  const char *queries_fname = argv[argc-2];
+  double r = atof(argv[argc-1]);
+
+  int n_points = -1;
+  int d;
+  enum point_type type;
+  struct file_map points_map;
+  const void* points = map_points_typed(points_fname, ACCESS_NORMAL,
+                                        &n_points, &d, &type, &points_map);
+  if (points == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", points_fname);
+    exit(1);
+  }
+
+  int n_queries = -1;
+  int d_queries;
+  struct file_map queries_map;
+  const double* queries = map_points(queries_fname, ACCESS_SEQUENTIAL,
+                                     &n_queries, &d_queries, &queries_map);
+  if (queries == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", queries_fname);
+    exit(1);
+  }
+
+  if (d != d_queries) {
+    fprintf(stderr, "Reference points have dimensionality %d, but query points have dimensionality %d\n",
+            (int)d, (int)d_queries);
+    exit(1);
+  }
+
+  struct kdtree *kdtree;
+  if (type == POINT_F32) {
+    kdtree = kdtree_create_f32(d, n_points, points);
+  } else {
+    kdtree = kdtree_create(d, n_points, points);
+  }
+
+  // The same result buffer is reused for all queries.
+  struct kdtree_matches matches = { 0, 0, NULL };
+  long total = 0;
+
+  double start = seconds();
+  for (int q = 0; q < n_queries; q++) {
+    const double *query = &queries[(size_t)q*d];
+    if (count_only) {
+      int count = kdtree_radius_count(kdtree, r, query);
+      printf("Query %d: %d\n", q, count);
+      total += count;
+    } else {
+      kdtree_radius_search(kdtree, r, query, &matches);
+      hpps_sort_ints(matches.indexes, matches.n);
+      printf("Query %d: ", q);
+      for (int i = 0; i < matches.n; i++) {
+        printf("%d ", matches.indexes[i]);
+      }
+      printf("\n");
+      total += matches.n;
+    }
+  }
+  double elapsed = seconds()-start;
+
+  printf("Points within %g: %ld (%.1f per query)\n",
+         r, total, n_queries > 0 ? (double)total/n_queries : 0.0);
+  printf("Running queries: %.3fs\n", elapsed);
+
+  free(matches.indexes);
+  kdtree_free(kdtree);
+  unmap_file(&points_map);
+  unmap_file(&queries_map);
+
+  return 0;
+}
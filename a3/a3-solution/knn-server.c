@@ -0,0 +1,315 @@
+// A long-running k-NN query server.  The k-d tree is built (or loaded)
+// once, after which query points are read from standard input and the
+// indexes of their neighbours are written to standard output, until
+// standard input is closed.  To serve a socket instead, connect it to
+// standard input and output with e.g. socat.
+//
+// A query is 'd' doubles in native byte order, without any header, and
+// its result is 'k' 32-bit ints, just like a row of an indexes file.
+// So for a queries file and the matching indexes file
+//
+//   tail -c +9 queries | ./knn-server points k | cmp - <(tail -c +9 indexes)
+//
+// Queries are answered in batches of whatever has arrived, up to a
+// maximum batch size, so a steady trickle of queries is answered
+// immediately while a flood is processed in parallel.  Results are
+// written by a separate thread from one of two buffers, so writing a
+// batch overlaps with searching for the next one.
+//
+// On exit, throughput and latency statistics are printed to standard
+// error.  The latency of a query is measured from when it was read to
+// when its result had been written.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "io.h"
+#include "kdtree.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Latencies are counted in buckets that grow by 5%, starting from one
+// microsecond, so percentiles are accurate to within 5% while the
+// memory needed does not depend on the number of queries.
+#define LATENCY_BUCKETS 512
+#define LATENCY_GROWTH 1.05
+
+struct latencies {
+  long counts[LATENCY_BUCKETS];
+  long n;
+  double max;
+};
+
+static void latency_add(struct latencies *lat, double seconds, long count) {
+  double us = seconds * 1e6;
+  int bucket = us <= 1 ? 0 : (int)ceil(log(us) / log(LATENCY_GROWTH));
+  if (bucket >= LATENCY_BUCKETS) {
+    bucket = LATENCY_BUCKETS-1;
+  }
+  lat->counts[bucket] += count;
+  lat->n += count;
+  if (seconds > lat->max) {
+    lat->max = seconds;
+  }
+}
+
+// The upper bound, in seconds, of the bucket containing the 'p'th
+// percentile, but no more than the maximum.
+static double latency_percentile(const struct latencies *lat, double p) {
+  long rank = (long)ceil(p / 100 * lat->n);
+  long seen = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += lat->counts[i];
+    if (seen >= rank) {
+      double bound = pow(LATENCY_GROWTH, i) / 1e6;
+      return bound < lat->max ? bound : lat->max;
+    }
+  }
+  return lat->max;
+}
+
+// One of the two output buffers.
+struct batch {
+  int n;
+  int *indexes;
+
+  // When the queries of the batch were read.
+  double arrival;
+};
+
+// State shared between the searching (main) thread and the writer.
+struct writer {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  // The batch waiting to be written, or NULL, and whether there will
+  // be no more batches.
+  struct batch *pending;
+  int done;
+
+  int k;
+
+  // Only touched by the writer thread until it has been joined.
+  struct latencies lat;
+  long batches;
+  double last_write;
+};
+
+// Write all of 'buf', retrying on partial writes.
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t written = write(fd, p, len);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return 1;
+    }
+    p += written;
+    len -= written;
+  }
+  return 0;
+}
+
+static void* writer_thread(void *arg) {
+  struct writer *w = arg;
+
+  while (1) {
+    pthread_mutex_lock(&w->mutex);
+    while (w->pending == NULL && !w->done) {
+      pthread_cond_wait(&w->cond, &w->mutex);
+    }
+    struct batch *batch = w->pending;
+    pthread_mutex_unlock(&w->mutex);
+
+    if (batch == NULL) {
+      return NULL;
+    }
+
+    if (write_all(STDOUT_FILENO, batch->indexes,
+                  (size_t)batch->n * w->k * sizeof(int)) != 0) {
+      fprintf(stderr, "Failed writing results: %s\n", strerror(errno));
+      exit(1);
+    }
+
+    double now = seconds();
+    latency_add(&w->lat, now - batch->arrival, batch->n);
+    w->batches++;
+    w->last_write = now;
+
+    // Hand the buffer back.
+    pthread_mutex_lock(&w->mutex);
+    w->pending = NULL;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+  }
+}
+
+// Wait until the writer is idle, then give it 'batch' (or NULL and
+// 'done', to make it stop).
+static void writer_submit(struct writer *w, struct batch *batch, int done) {
+  pthread_mutex_lock(&w->mutex);
+  while (w->pending != NULL) {
+    pthread_cond_wait(&w->cond, &w->mutex);
+  }
+  w->pending = batch;
+  w->done = done;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--index <index-file>] [--batch <max-queries>] <points> <k>\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  const char *index_fname = NULL;
+  int max_batch = 4096;
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--index") == 0 && argi+1 < argc) {
+      index_fname = argv[++argi];
+    } else if (strcmp(argv[argi], "--batch") == 0 && argi+1 < argc) {
+      max_batch = atoi(argv[++argi]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  if (argc - argi != 2 || max_batch < 1) {
+    usage(argv[0]);
+  }
+  const char *points_fname = argv[argi];
+  int k = atoi(argv[argi+1]);
+
+  int n_points = -1;
+  int d;
+  enum point_type type;
+  struct file_map points_map;
+  const void* points = map_points_typed(points_fname, ACCESS_NORMAL,
+                                        &n_points, &d, &type, &points_map);
+  if (points == NULL) {
+    fprintf(stderr, "Failed reading data from %s\n", points_fname);
+    exit(1);
+  }
+
+  struct kdtree *kdtree;
+  double start = seconds();
+  if (index_fname != NULL) {
+    kdtree = kdtree_load(index_fname);
+    if (kdtree == NULL) {
+      fprintf(stderr, "Failed reading index from %s\n", index_fname);
+      exit(1);
+    }
+    if (kdtree_dims(kdtree) != d || kdtree_size(kdtree) != n_points) {
+      fprintf(stderr, "Index %s does not match %s\n", index_fname, points_fname);
+      exit(1);
+    }
+  } else if (type == POINT_F32) {
+    kdtree = kdtree_create_f32(d, n_points, points);
+  } else {
+    kdtree = kdtree_create(d, n_points, points);
+  }
+  fprintf(stderr, "Ready: %d points of dimension %d, k=%d (%.3fs)\n",
+          n_points, d, k, seconds()-start);
+
+  size_t record = (size_t)d * sizeof(double);
+  char *input = malloc(max_batch * record);
+  size_t input_len = 0;
+
+  struct batch batches[2];
+  for (int i = 0; i < 2; i++) {
+    batches[i].n = 0;
+    batches[i].indexes = malloc((size_t)max_batch * k * sizeof(int));
+  }
+  int current = 0;
+
+  struct writer w;
+  memset(&w, 0, sizeof(w));
+  pthread_mutex_init(&w.mutex, NULL);
+  pthread_cond_init(&w.cond, NULL);
+  w.k = k;
+
+  pthread_t writer;
+  pthread_create(&writer, NULL, writer_thread, &w);
+
+  long n_queries = 0;
+  double first_read = -1;
+  int eof = 0;
+  while (!eof) {
+    // Block until some input is available, then take whatever has
+    // arrived, up to a full batch.
+    ssize_t got = read(STDIN_FILENO, input + input_len, max_batch * record - input_len);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      fprintf(stderr, "Failed reading queries: %s\n", strerror(errno));
+      exit(1);
+    }
+    if (got == 0) {
+      eof = 1;
+    }
+    input_len += got;
+
+    int n = input_len / record;
+    if (n == 0) {
+      continue;
+    }
+
+    struct batch *batch = &batches[current];
+    batch->n = n;
+    batch->arrival = seconds();
+    if (first_read < 0) {
+      first_read = batch->arrival;
+    }
+
+    kdtree_knn_batch(kdtree, k, n, (const double*)input, batch->indexes);
+    n_queries += n;
+
+    // Keep any partial record for the next round.
+    memmove(input, input + n*record, input_len - n*record);
+    input_len -= n*record;
+
+    // The writer is still busy with the other buffer at most.
+    writer_submit(&w, batch, 0);
+    current = 1 - current;
+  }
+
+  if (input_len != 0) {
+    fprintf(stderr, "Ignoring %d trailing bytes of an incomplete query\n",
+            (int)input_len);
+  }
+
+  writer_submit(&w, NULL, 1);
+  pthread_join(writer, NULL);
+
+  double elapsed = n_queries > 0 ? w.last_write - first_read : 0;
+  fprintf(stderr, "Queries: %ld in %ld batches\n", n_queries, w.batches);
+  fprintf(stderr, "Throughput: %.0f queries/s\n",
+          elapsed > 0 ? n_queries / elapsed : 0.0);
+  if (n_queries > 0) {
+    fprintf(stderr, "Latency: p50 %.1fus, p99 %.1fus, max %.1fus\n",
+            latency_percentile(&w.lat, 50) * 1e6,
+            latency_percentile(&w.lat, 99) * 1e6,
+            w.lat.max * 1e6);
+  }
+
+  pthread_mutex_destroy(&w.mutex);
+  pthread_cond_destroy(&w.cond);
+  free(input);
+  free(batches[0].indexes);
+  free(batches[1].indexes);
+  kdtree_free(kdtree);
+  unmap_file(&points_map);
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+// For O_DIRECT and posix_memalign().
+#define _GNU_SOURCE
+
+#include "outbuf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The buffer size is a multiple of any plausible block size, as
+// required for O_DIRECT, and so is its alignment.
+#define OUTBUF_SIZE (1<<20)
+#define OUTBUF_ALIGN 4096
+
+static int outbuf_init(struct outbuf *out, int fd, int owns_fd, int direct) {
+  void *buf;
+  if (posix_memalign(&buf, OUTBUF_ALIGN, OUTBUF_SIZE) != 0) {
+    return 1;
+  }
+  out->fd = fd;
+  out->owns_fd = owns_fd;
+  out->direct = direct;
+  out->error = 0;
+  out->buf = buf;
+  out->size = OUTBUF_SIZE;
+  out->len = 0;
+  return 0;
+}
+
+int outbuf_open(struct outbuf *out, const char *filename, int direct) {
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  int fd = -1;
+
+#ifdef O_DIRECT
+  if (direct) {
+    fd = open(filename, flags | O_DIRECT, 0666);
+  }
+#endif
+  // Either O_DIRECT was not requested, or not available, or the file
+  // system rejected it (tmpfs does).
+  if (fd < 0) {
+    direct = 0;
+    fd = open(filename, flags, 0666);
+  }
+  if (fd < 0) {
+    return 1;
+  }
+
+  if (outbuf_init(out, fd, 1, direct) != 0) {
+    close(fd);
+    return 1;
+  }
+  return 0;
+}
+
+int outbuf_fd(struct outbuf *out, int fd) {
+  return outbuf_init(out, fd, 0, 0);
+}
+
+static void write_all(struct outbuf *out, const char *p, size_t len) {
+  while (len > 0 && !out->error) {
+    ssize_t written = write(out->fd, p, len);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      out->error = 1;
+      return;
+    }
+    p += written;
+    len -= written;
+  }
+}
+
+void outbuf_flush(struct outbuf *out) {
+#ifdef O_DIRECT
+  if (out->direct && out->len % OUTBUF_ALIGN != 0) {
+    // The tail is not a whole number of blocks, so it has to go
+    // through the page cache after all.
+    int flags = fcntl(out->fd, F_GETFL);
+    if (flags == -1 || fcntl(out->fd, F_SETFL, flags & ~O_DIRECT) == -1) {
+      out->error = 1;
+    }
+    out->direct = 0;
+  }
+#endif
+  write_all(out, out->buf, out->len);
+  out->len = 0;
+}
+
+void outbuf_write(struct outbuf *out, const void *data, size_t len) {
+  const char *p = data;
+
+  // Large writes to an empty buffer need not be copied, unless the
+  // data has to be aligned.
+  if (out->len == 0 && len >= out->size && !out->direct) {
+    write_all(out, p, len);
+    return;
+  }
+
+  while (len > 0) {
+    size_t n = out->size - out->len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(out->buf + out->len, p, n);
+    out->len += n;
+    p += n;
+    len -= n;
+
+    if (out->len == out->size) {
+      write_all(out, out->buf, out->len);
+      out->len = 0;
+    }
+  }
+}
+
+void outbuf_str(struct outbuf *out, const char *s) {
+  outbuf_write(out, s, strlen(s));
+}
+
+void outbuf_char(struct outbuf *out, char c) {
+  if (out->len == out->size) {
+    write_all(out, out->buf, out->len);
+    out->len = 0;
+  }
+  out->buf[out->len++] = c;
+}
+
+void outbuf_int(struct outbuf *out, int x) {
+  if (out->size - out->len < 11) {
+    char tmp[11];
+    outbuf_write(out, tmp, format_int(tmp, x));
+  } else {
+    out->len += format_int(out->buf + out->len, x);
+  }
+}
+
+int outbuf_close(struct outbuf *out) {
+  outbuf_flush(out);
+  if (out->owns_fd && close(out->fd) != 0) {
+    out->error = 1;
+  }
+  free(out->buf);
+  out->buf = NULL;
+  return out->error;
+}
+
+// The two-digit decimal representations of 0 to 99, so that digits
+// can be produced two at a time.
+static const char digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+int format_int(char *dst, int x) {
+  char tmp[10];
+  int n = 0;
+  int len = 0;
+
+  // Work on the magnitude as unsigned, which also handles INT_MIN.
+  unsigned int u = x;
+  if (x < 0) {
+    dst[len++] = '-';
+    u = -u;
+  }
+
+  // Produce digits from the end, two at a time.
+  while (u >= 100) {
+    unsigned int r = u % 100;
+    u /= 100;
+    tmp[n++] = digit_pairs[2*r+1];
+    tmp[n++] = digit_pairs[2*r];
+  }
+  if (u >= 10) {
+    tmp[n++] = digit_pairs[2*u+1];
+    tmp[n++] = digit_pairs[2*u];
+  } else {
+    tmp[n++] = '0' + u;
+  }
+
+  while (n > 0) {
+    dst[len++] = tmp[--n];
+  }
+  return len;
+}
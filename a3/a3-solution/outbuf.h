@@ -0,0 +1,66 @@
+#ifndef KNN_OUTBUF_H
+#define KNN_OUTBUF_H
+
+#include <stddef.h>
+
+// Buffered output straight to a file descriptor, bypassing stdio.
+//
+// Data is collected in a large, page-aligned buffer and written with
+// as few write() calls as possible.  As the buffer is aligned and only
+// written in whole buffers until the very end, a file can also be
+// opened with O_DIRECT (where supported), so that writing a large
+// result does not push everything else out of the page cache.
+//
+// Errors are remembered rather than reported by every call, and
+// returned by outbuf_close().
+struct outbuf {
+  int fd;
+  int owns_fd;
+  int direct;
+  int error;
+  char *buf;
+  size_t size;
+  size_t len;
+};
+
+// Create (or truncate) the file 'filename' for writing.  If 'direct'
+// is nonzero, try to open it with O_DIRECT, falling back to normal
+// buffered writes if the file system does not support that.  Returns
+// 1 on error and 0 on success.
+int outbuf_open(struct outbuf *out, const char *filename, int direct);
+
+// Write to an already open file descriptor, such as STDOUT_FILENO.
+// Anything written to the same descriptor by other means (e.g.
+// printf()) must be flushed first.  outbuf_close() does not close
+// the descriptor.
+int outbuf_fd(struct outbuf *out, int fd);
+
+// Append 'len' bytes.
+void outbuf_write(struct outbuf *out, const void *data, size_t len);
+
+// Append a string, without its NUL terminator.
+void outbuf_str(struct outbuf *out, const char *s);
+
+// Append a single character.
+void outbuf_char(struct outbuf *out, char c);
+
+// Append the decimal representation of 'x'.
+void outbuf_int(struct outbuf *out, int x);
+
+// Write everything that is buffered.  This cannot be done with
+// O_DIRECT except at the end, so it is only for descriptors opened
+// with outbuf_fd().
+void outbuf_flush(struct outbuf *out);
+
+// Flush, free the buffer and close the file if it was opened by
+// outbuf_open().  Returns 1 if any error occurred since the outbuf
+// was opened, and 0 otherwise.
+int outbuf_close(struct outbuf *out);
+
+// Write the decimal representation of 'x' to 'dst', which must have
+// room for at least 11 characters, and return the number of
+// characters written.  No NUL terminator is written.  This is much
+// faster than sprintf().
+int format_int(char *dst, int x);
+
+#endif
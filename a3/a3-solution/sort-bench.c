@@ -0,0 +1,75 @@
+// Benchmark of hpps_parallel_sort() against hpps_quicksort() on
+// random doubles, sorted through a comparison function as users of
+// sort.h do, and of hpps_radix_sort_keys() on the same doubles.  The
+// number of threads is controlled with OMP_NUM_THREADS; see the
+// 'bench-sort' rule in the Makefile.
+
+#include "sort.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <omp.h>
+
+static int cmp_doubles(const void *px, const void *py, void *arg) {
+  (void)arg;
+  double x = *(const double*)px;
+  double y = *(const double*)py;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: %s <n> [distinct-values]\n", argv[0]);
+    exit(1);
+  }
+
+  int n = atoi(argv[1]);
+  // Optionally draw from few distinct values, to check that many
+  // duplicates are handled well.
+  int distinct = argc == 3 ? atoi(argv[2]) : 0;
+  assert(n > 0 && distinct >= 0);
+
+  srand(1);
+  double *input = malloc((size_t)n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    input[i] = distinct > 0 ? rand() % distinct : ((double)rand())/RAND_MAX;
+  }
+
+  double *seq = malloc((size_t)n * sizeof(double));
+  double *par = malloc((size_t)n * sizeof(double));
+  memcpy(seq, input, (size_t)n * sizeof(double));
+  memcpy(par, input, (size_t)n * sizeof(double));
+
+  double start = seconds();
+  hpps_quicksort(seq, n, sizeof(double), cmp_doubles, NULL);
+  double sequential = seconds() - start;
+
+  start = seconds();
+  hpps_parallel_sort(par, n, sizeof(double), cmp_doubles, NULL);
+  double parallel = seconds() - start;
+
+  int *perm = malloc((size_t)n * sizeof(int));
+  start = seconds();
+  hpps_radix_sort_keys(input, n, sizeof(double), HPPS_KEY_DOUBLE, perm);
+  double radix = seconds() - start;
+
+  // All results consist of the same doubles in sorted order, so they
+  // must be identical.
+  int ok = memcmp(seq, par, (size_t)n * sizeof(double)) == 0;
+  for (int i = 0; i < n; i++) {
+    ok = ok && input[perm[i]] == seq[i];
+  }
+
+  printf("%s: n=%d threads=%d sequential=%.3fs parallel=%.3fs speedup=%.2fx radix=%.3fs %s\n",
+         argv[0], n, omp_get_max_threads(), sequential, parallel,
+         sequential/parallel, radix, ok ? "ok" : "MISMATCH");
+
+  free(perm);
+  free(input);
+  free(seq);
+  free(par);
+
+  return !ok;
+}
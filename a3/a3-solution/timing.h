@@ -0,0 +1,16 @@
+#ifndef KNN_TIMING_H
+#define KNN_TIMING_H
+
+#include <sys/time.h>
+#include <stdlib.h>
+
+// Return the number of seconds since some unspecified time.  Timing
+// can be done by calling this function multiple times and subtracting
+// the return values.
+static double seconds(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL); // The NULL is for timezone information.
+  return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include "util.h"
+#include <math.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+double distance(int d, const double *x, const double *y) {
+  double sum = 0;
+  for (int i = 0; i < d; i++) {
+    double diff = x[i] - y[i];
+    sum += diff * diff;
+  }
+  return sqrt(sum);
+}
+
+void sq_distances_soa(int d, int n, const double *points,
+                      const double *query, double *out) {
+  int i = 0;
+
+#if defined(__AVX__)
+  for (; i+4 <= n; i += 4) {
+    __m256d acc = _mm256_setzero_pd();
+    for (int j = 0; j < d; j++) {
+      __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(&points[j*n+i]),
+                                   _mm256_set1_pd(query[j]));
+      acc = _mm256_add_pd(acc, _mm256_mul_pd(diff, diff));
+    }
+    _mm256_storeu_pd(&out[i], acc);
+  }
+#elif defined(__SSE2__)
+  for (; i+2 <= n; i += 2) {
+    __m128d acc = _mm_setzero_pd();
+    for (int j = 0; j < d; j++) {
+      __m128d diff = _mm_sub_pd(_mm_loadu_pd(&points[j*n+i]),
+                                _mm_set1_pd(query[j]));
+      acc = _mm_add_pd(acc, _mm_mul_pd(diff, diff));
+    }
+    _mm_storeu_pd(&out[i], acc);
+  }
+#endif
+
+  // Whatever is left over after the vector loop (or everything, if
+  // we have no vector instructions).
+  for (; i < n; i++) {
+    double sum = 0;
+    for (int j = 0; j < d; j++) {
+      double diff = points[j*n+i] - query[j];
+      sum += diff * diff;
+    }
+    out[i] = sum;
+  }
+}
+
+void sq_distances_soa_f32(int d, int n, const float *points,
+                          const float *query, double *out) {
+  int i = 0;
+
+#if defined(__AVX__)
+  for (; i+8 <= n; i += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int j = 0; j < d; j++) {
+      __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(&points[j*n+i]),
+                                  _mm256_set1_ps(query[j]));
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(diff, diff));
+    }
+    _mm256_storeu_pd(&out[i], _mm256_cvtps_pd(_mm256_castps256_ps128(acc)));
+    _mm256_storeu_pd(&out[i+4], _mm256_cvtps_pd(_mm256_extractf128_ps(acc, 1)));
+  }
+#elif defined(__SSE2__)
+  for (; i+4 <= n; i += 4) {
+    __m128 acc = _mm_setzero_ps();
+    for (int j = 0; j < d; j++) {
+      __m128 diff = _mm_sub_ps(_mm_loadu_ps(&points[j*n+i]),
+                               _mm_set1_ps(query[j]));
+      acc = _mm_add_ps(acc, _mm_mul_ps(diff, diff));
+    }
+    _mm_storeu_pd(&out[i], _mm_cvtps_pd(acc));
+    _mm_storeu_pd(&out[i+2], _mm_cvtps_pd(_mm_movehl_ps(acc, acc)));
+  }
+#endif
+
+  for (; i < n; i++) {
+    float sum = 0;
+    for (int j = 0; j < d; j++) {
+      float diff = points[j*n+i] - query[j];
+      sum += diff * diff;
+    }
+    out[i] = sum;
+  }
+}
+
+int insert_if_closer(int k, int d,
+                     const double *points, int *closest, const double *query,
+                     int candidate) {
+  double candidate_dist = distance(d, &points[candidate*d], query);
+
+  // Find the position at which the candidate should be inserted.
+  // Absent elements (-1) are always at the end of 'closest'.
+  int i = k;
+  while (i > 0 &&
+         (closest[i-1] == -1 ||
+          distance(d, &points[closest[i-1]*d], query) > candidate_dist)) {
+    i--;
+  }
+
+  if (i == k) {
+    return 0;
+  }
+
+  // Shift the more distant elements one step to the right, dropping
+  // the last one.
+  for (int j = k-1; j > i; j--) {
+    closest[j] = closest[j-1];
+  }
+  closest[i] = candidate;
+
+  return 1;
+}
+
+// Is candidate 'i' more distant than candidate 'j'?
+static int heap_after(const struct knn_heap *heap, int i, int j) {
+  return heap->dists[i] > heap->dists[j]
+    || (heap->dists[i] == heap->dists[j] && heap->indexes[i] > heap->indexes[j]);
+}
+
+static void heap_swap(struct knn_heap *heap, int i, int j) {
+  double dist = heap->dists[i];
+  heap->dists[i] = heap->dists[j];
+  heap->dists[j] = dist;
+  int index = heap->indexes[i];
+  heap->indexes[i] = heap->indexes[j];
+  heap->indexes[j] = index;
+}
+
+static void heap_sift_down(struct knn_heap *heap, int i) {
+  while (1) {
+    int largest = i;
+    int l = 2*i+1;
+    int r = 2*i+2;
+    if (l < heap->size && heap_after(heap, l, largest)) {
+      largest = l;
+    }
+    if (r < heap->size && heap_after(heap, r, largest)) {
+      largest = r;
+    }
+    if (largest == i) {
+      return;
+    }
+    heap_swap(heap, i, largest);
+    i = largest;
+  }
+}
+
+void knn_heap_init(struct knn_heap *heap, int k, double *dists, int *indexes) {
+  heap->k = k;
+  heap->size = 0;
+  heap->dists = dists;
+  heap->indexes = indexes;
+}
+
+double knn_heap_radius(const struct knn_heap *heap) {
+  if (heap->k == 0) {
+    // An empty heap with no room admits nothing.
+    return -INFINITY;
+  }
+  return heap->size < heap->k ? INFINITY : heap->dists[0];
+}
+
+int knn_heap_push(struct knn_heap *heap, double dist, int index) {
+  if (heap->size < heap->k) {
+    // Not full yet: add at the end and sift up.
+    int i = heap->size++;
+    heap->dists[i] = dist;
+    heap->indexes[i] = index;
+    while (i > 0 && heap_after(heap, i, (i-1)/2)) {
+      heap_swap(heap, i, (i-1)/2);
+      i = (i-1)/2;
+    }
+    return 1;
+  }
+
+  if (heap->k == 0
+      || dist > heap->dists[0]
+      || (dist == heap->dists[0] && index >= heap->indexes[0])) {
+    return 0;
+  }
+
+  // Replace the most distant candidate.
+  heap->dists[0] = dist;
+  heap->indexes[0] = index;
+  heap_sift_down(heap, 0);
+  return 1;
+}
+
+void knn_heap_sort(struct knn_heap *heap) {
+  int n = heap->size;
+
+  // Heapsort: repeatedly move the most distant remaining candidate to
+  // the end.
+  while (heap->size > 1) {
+    heap_swap(heap, 0, heap->size-1);
+    heap->size--;
+    heap_sift_down(heap, 0);
+  }
+  heap->size = 0;
+
+  for (int i = n; i < heap->k; i++) {
+    heap->indexes[i] = -1;
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef KNN_UTIL_H
+#define KNN_UTIL_H
+
+// Compute the Euclidean distance between two d-dimensional points 'x'
+// and 'y'.  Usual formula:
+//
+//
+// √( ∑ (x[i]-y[i])² )
+//
+double distance(int d, const double *x, const double *y);
+
+// Compute the squared Euclidean distances from 'query' to each of 'n'
+// 'd'-dimensional points stored in struct-of-arrays form, meaning
+// that coordinate 'j' of point 'i' is at 'points[j*n+i]'.  The 'n'
+// results are written to 'out'.
+//
+// This is vectorised with AVX or SSE2 when the compiler targets
+// those, and otherwise falls back to a plain loop.  The vector and
+// scalar code perform the same operations in the same order, so they
+// produce bit-identical results.
+void sq_distances_soa(int d, int n, const double *points,
+                      const double *query, double *out);
+
+// Like sq_distances_soa(), but for single precision points.  The
+// distances are also computed in single precision, but returned as
+// doubles.
+void sq_distances_soa_f32(int d, int n, const float *points,
+                          const float *query, double *out);
+
+// Maintain a sorted sequence of indexes to the 'k' closest point seen
+// so far.
+//
+// 'd' is the number of dimensions in the space.
+//
+// 'points' is the array of all reference points.
+//
+// 'closest' is an array of length 'k' that contains valid indexes
+// into 'points', or -1 to indicate the absence of an element.
+//
+// 'query' is the query point from which distances are computed.
+//
+// 'candidate' is the index of a point in 'points'.
+//
+// Updates 'closest' to contain 'candidate' if 'candidate' is closer
+// to 'query' than any point in 'closest'.
+//
+// Returns 1 if 'closest' was updated, and otherwise '0'.
+int insert_if_closer(int k, int d,
+                     const double *points, int *closest, const double *query,
+                     int candidate);
+
+// A max-heap of at most 'k' candidate neighbours, used instead of
+// insert_if_closer() when the number of candidates is large.  The
+// distance of each candidate is stored next to its index, so it is
+// never recomputed, and the most distant candidate is always at the
+// root.
+//
+// Candidates are ordered by distance, and candidates at the same
+// distance by index, so the final result does not depend on the order
+// in which candidates were offered.
+//
+// The heap does not own its storage: both arrays are provided by the
+// caller, which makes it possible to keep one heap per thread and
+// reuse it for many queries.
+struct knn_heap {
+  int k;
+  int size;
+
+  // Squared distances of the candidates.
+  double *dists;
+
+  // Indexes of the candidates.
+  int *indexes;
+};
+
+// Initialise an empty heap with room for 'k' candidates, using the
+// 'k'-element arrays 'dists' and 'indexes' as storage.
+void knn_heap_init(struct knn_heap *heap, int k, double *dists, int *indexes);
+
+// The squared distance that a candidate must beat to enter the heap:
+// the distance of the most distant candidate if the heap is full, and
+// otherwise infinity.  If k is 0, nothing can enter, and the radius is
+// minus infinity.  This is O(1).
+double knn_heap_radius(const struct knn_heap *heap);
+
+// Offer the candidate 'index' with squared distance 'dist' to the
+// heap.  It is added if the heap is not full, or if it is closer than
+// the most distant candidate, which is then dropped.  Returns 1 if
+// the heap was changed, and otherwise 0.
+int knn_heap_push(struct knn_heap *heap, double dist, int index);
+
+// Sort the 'indexes' array in order of increasing distance, and pad
+// it to 'k' elements with -1.  The heap is empty afterwards.
+void knn_heap_sort(struct knn_heap *heap);
+
+#endif
@@ -0,0 +1,76 @@
+#include "io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdint.h>
+
+int main(int argc, char** argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "Usage: %s <points> <indexes> [true-indexes]\n", argv[0]);
+    exit(1);
+  }
+
+  int n_points, d;
+  struct file_map points_map;
+  const double *points = map_points(argv[1], ACCESS_NORMAL, &n_points, &d, &points_map);
+  assert(points != NULL);
+
+  int n_indexes, k;
+  struct file_map indexes_map;
+  const int *indexes = map_indexes(argv[2], ACCESS_SEQUENTIAL, &n_indexes, &k, &indexes_map);
+  assert(indexes != NULL);
+
+  // Queries with fewer than k neighbours, such as when k > n or when
+  // searching within a radius, are padded with -1.
+  for (int i = 0; i < n_indexes; i++) {
+    for (int j = 0; j < k; j++) {
+      int x = indexes[i*k+j];
+      if (x < -1 || x >= n_points) {
+        printf("Invalid index: %d\n", x);
+        exit(1);
+      }
+    }
+  }
+
+  // Given the exact neighbours (e.g. from knn-bruteforce), report the
+  // recall: the fraction of true neighbours that were found.  The
+  // order within each query does not matter, and padding is not a
+  // neighbour.
+  if (argc == 4) {
+    int n_true, k_true;
+    struct file_map true_map;
+    const int *true_indexes = map_indexes(argv[3], ACCESS_SEQUENTIAL, &n_true, &k_true, &true_map);
+    assert(true_indexes != NULL);
+
+    if (n_true != n_indexes || k_true != k) {
+      fprintf(stderr, "%s has %d queries with k=%d, but %s has %d queries with k=%d\n",
+              argv[2], n_indexes, k, argv[3], n_true, k_true);
+      exit(1);
+    }
+
+    long found = 0;
+    long total = 0;
+    for (int i = 0; i < n_indexes; i++) {
+      for (int l = 0; l < k; l++) {
+        if (true_indexes[i*k+l] == -1) {
+          continue;
+        }
+        total++;
+        for (int j = 0; j < k; j++) {
+          if (indexes[i*k+j] == true_indexes[i*k+l]) {
+            found++;
+            break;
+          }
+        }
+      }
+    }
+
+    printf("Recall@%d: %.4f (%ld of %ld)\n",
+           k, total > 0 ? (double)found/total : 1.0, found, total);
+
+    unmap_file(&true_map);
+  }
+
+  unmap_file(&points_map);
+  unmap_file(&indexes_map);
+}
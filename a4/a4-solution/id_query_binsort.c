@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "record.h"
+#include "id_query.h"
+#include "sort.h"
+
+// The IDs in ascending order, and the record of each.  The keys are
+// kept apart from the records, so the binary search only touches the
+// keys.
+struct binsort_data {
+  int64_t *keys;
+  const struct record **records;
+  int n;
+};
+
+struct binsort_data* mk_binsort(struct record* rs, int n) {
+  struct binsort_data *data = malloc(sizeof(struct binsort_data));
+  data->keys = malloc(n * sizeof(int64_t));
+  data->records = malloc(n * sizeof(const struct record*));
+  data->n = n;
+
+  // The sort is stable, so of several records with the same ID, the
+  // first one in the file comes first, and is the one found.
+  int *perm = malloc(n * sizeof(int));
+  hpps_radix_sort_keys(&rs[0].osm_id, n, sizeof(struct record),
+                       HPPS_KEY_INT64, perm);
+  for (int i = 0; i < n; i++) {
+    data->keys[i] = rs[perm[i]].osm_id;
+    data->records[i] = &rs[perm[i]];
+  }
+  free(perm);
+
+  return data;
+}
+
+void free_binsort(struct binsort_data* data) {
+  free(data->keys);
+  free(data->records);
+  free(data);
+}
+
+// Find the first key that is not less than the needle.  The loop
+// always runs log2(n) times and only moves 'base' with a conditional
+// move, so there are no mispredicted branches.
+const struct record* lookup_binsort(struct binsort_data *data, int64_t needle) {
+  const int64_t *base = data->keys;
+  size_t n = data->n;
+  if (n == 0) {
+    return NULL;
+  }
+  while (n > 1) {
+    size_t half = n / 2;
+    base = base[half-1] < needle ? base + half : base;
+    n -= half;
+  }
+  base += *base < needle;
+
+  if (base < data->keys + data->n && *base == needle) {
+    return data->records[base - data->keys];
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  return id_query_loop(argc, argv,
+                    (mk_index_fn)mk_binsort,
+                    (free_index_fn)free_binsort,
+                    (lookup_fn)lookup_binsort);
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "record.h"
+#include "id_query.h"
+#include "sort.h"
+
+// The sorted IDs laid out in Eytzinger (breadth-first) order: the root
+// of the implicit search tree is at index 1, and the children of node
+// 'k' are at '2k' and '2k+1'.  Index 0 is unused.  The records are
+// stored in the same order.
+//
+// Compared to a binary search on the sorted array, the first levels of
+// the tree share a few cache lines that stay in cache, and all the
+// nodes three levels below node 'k' are in the single cache line
+// starting at '8k', which can be prefetched long before it is needed.
+struct eytzinger_data {
+  int64_t *keys;
+  const struct record **records;
+  int n;
+};
+
+#define CACHE_LINE 64
+
+// Fill the subtree rooted at node 'k' from the sorted arrays, starting
+// at position 'i' of those, and return the position after the last
+// one used.
+static int fill(struct eytzinger_data *data, const int64_t *keys,
+                const struct record **records, int i, size_t k) {
+  if (k <= (size_t)data->n) {
+    i = fill(data, keys, records, i, 2*k);
+    data->keys[k] = keys[i];
+    data->records[k] = records[i];
+    i++;
+    i = fill(data, keys, records, i, 2*k+1);
+  }
+  return i;
+}
+
+struct eytzinger_data* mk_eytzinger(struct record* rs, int n) {
+  struct eytzinger_data *data = malloc(sizeof(struct eytzinger_data));
+  data->n = n;
+
+  // Aligned, so that the eight nodes below each node 'k' share a cache
+  // line.
+  void *keys;
+  int err = posix_memalign(&keys, CACHE_LINE, ((size_t)n + 1) * sizeof(int64_t));
+  assert(err == 0);
+  data->keys = keys;
+  data->records = malloc(((size_t)n + 1) * sizeof(const struct record*));
+
+  // The sort is stable, so of several records with the same ID, the
+  // first one in the file comes first, and is the one found.
+  int *perm = malloc(n * sizeof(int));
+  int64_t *sorted_keys = malloc(n * sizeof(int64_t));
+  const struct record **sorted_records = malloc(n * sizeof(const struct record*));
+  hpps_radix_sort_keys(&rs[0].osm_id, n, sizeof(struct record),
+                       HPPS_KEY_INT64, perm);
+  for (int i = 0; i < n; i++) {
+    sorted_keys[i] = rs[perm[i]].osm_id;
+    sorted_records[i] = &rs[perm[i]];
+  }
+  fill(data, sorted_keys, sorted_records, 0, 1);
+  free(sorted_records);
+  free(sorted_keys);
+  free(perm);
+
+  return data;
+}
+
+void free_eytzinger(struct eytzinger_data* data) {
+  free(data->keys);
+  free(data->records);
+  free(data);
+}
+
+// Descend from the root, going right whenever the key is less than
+// the needle, until falling off the tree.  The path taken is then the
+// binary representation of 'k', and the first key not less than the
+// needle is where the search last went left, found by removing the
+// trailing right turns (ones) and the final left turn.
+const struct record* lookup_eytzinger(struct eytzinger_data *data, int64_t needle) {
+  const int64_t *keys = data->keys;
+  size_t n = data->n;
+  size_t k = 1;
+  while (k <= n) {
+    __builtin_prefetch(&keys[8*k]);
+    k = 2*k + (keys[k] < needle);
+  }
+  k >>= __builtin_ffsll(~k);
+
+  if (k != 0 && keys[k] == needle) {
+    return data->records[k];
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  return id_query_loop(argc, argv,
+                    (mk_index_fn)mk_eytzinger,
+                    (free_index_fn)free_eytzinger,
+                    (lookup_fn)lookup_eytzinger);
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "record.h"
+#include "id_query.h"
+
+// An open addressing hash table with Robin Hood hashing.  Every slot
+// holds the key next to the record, so a lookup usually needs only the
+// cache line of the key's home slot, and the slots are kept at most
+// MAX_LOAD_PERCENT full.
+//
+// Robin Hood hashing keeps the slots of a probe sequence ordered by
+// how far they are from their home slot: an insertion takes the slot
+// of any key closer to its home than the new one, and moves that key
+// further along instead.  This keeps all probe sequences short, and a
+// lookup can stop as soon as it meets a key closer to its home than
+// the needle would be, so unsuccessful lookups are also fast.
+#define MAX_LOAD_PERCENT 75
+
+struct slot {
+  int64_t key;
+  // NULL for an empty slot.
+  const struct record *record;
+};
+
+struct hash_data {
+  struct slot *slots;
+  // The number of slots is 2^bits.
+  int bits;
+  uint64_t mask;
+};
+
+// Fibonacci hashing: multiply by 2^64 divided by the golden ratio and
+// keep the top bits.  OSM IDs are far from random, and this spreads
+// consecutive IDs evenly over the table.
+static inline uint64_t home_slot(const struct hash_data *data, int64_t key) {
+  return ((uint64_t)key * UINT64_C(0x9e3779b97f4a7c15)) >> (64 - data->bits);
+}
+
+// How far slot 'i' is from the home slot of its key.
+static inline uint64_t probe_distance(const struct hash_data *data, uint64_t i) {
+  return (i - home_slot(data, data->slots[i].key)) & data->mask;
+}
+
+static void insert(struct hash_data *data, int64_t key, const struct record *record) {
+  uint64_t i = home_slot(data, key);
+  uint64_t dist = 0;
+  while (data->slots[i].record != NULL) {
+    // The first record with a given ID is the one found, as with the
+    // naive lookup.
+    if (data->slots[i].key == key) {
+      return;
+    }
+    uint64_t other_dist = probe_distance(data, i);
+    if (other_dist < dist) {
+      struct slot tmp = data->slots[i];
+      data->slots[i].key = key;
+      data->slots[i].record = record;
+      key = tmp.key;
+      record = tmp.record;
+      dist = other_dist;
+    }
+    i = (i + 1) & data->mask;
+    dist++;
+  }
+  data->slots[i].key = key;
+  data->slots[i].record = record;
+}
+
+struct hash_data* mk_hash(struct record* rs, int n) {
+  struct hash_data *data = malloc(sizeof(struct hash_data));
+  data->bits = 1;
+  while ((UINT64_C(1) << data->bits) * MAX_LOAD_PERCENT < (uint64_t)n * 100) {
+    data->bits++;
+  }
+  data->mask = (UINT64_C(1) << data->bits) - 1;
+  data->slots = calloc(data->mask + 1, sizeof(struct slot));
+
+  for (int i = 0; i < n; i++) {
+    insert(data, rs[i].osm_id, &rs[i]);
+  }
+  return data;
+}
+
+void free_hash(struct hash_data* data) {
+  free(data->slots);
+  free(data);
+}
+
+const struct record* lookup_hash(struct hash_data *data, int64_t needle) {
+  uint64_t i = home_slot(data, needle);
+  for (uint64_t dist = 0; ; dist++) {
+    const struct slot *slot = &data->slots[i];
+    if (slot->record == NULL || probe_distance(data, i) < dist) {
+      return NULL;
+    }
+    if (slot->key == needle) {
+      return slot->record;
+    }
+    i = (i + 1) & data->mask;
+  }
+}
+
+int main(int argc, char** argv) {
+  return id_query_loop(argc, argv,
+                    (mk_index_fn)mk_hash,
+                    (free_index_fn)free_hash,
+                    (lookup_fn)lookup_hash);
+}
@@ -0,0 +1,79 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// An OpenStreetMap place record.  All the 'const char*' strings point
+// into a private memory mapping of the file that the records were read
+// from, which is owned by the array of records as a whole, and is
+// unmapped by free_records().
+//
+// You don't need to worry about the meaning of these fields.  The
+// ones that matter are osm_id, lon, lat, and name.
+struct record {
+  const char *name;
+  const char *alternative_names;
+  const char *osm_type;
+  int64_t osm_id;
+  const char *class;
+  const char *type;
+  double lon;
+  double lat;
+  int place_rank;
+  double importance;
+  const char *street;
+  const char *city;
+  const char *county;
+  const char *state;
+  const char *country;
+  const char *country_code;
+  const char *display_name;
+  double west;
+  double south;
+  double east;
+  double north;
+  const char *wikidata;
+  const char *wikipedia;
+  const char *housenumbers;
+};
+
+// Read an OpenStreetMap place names dataset from a given file.  On
+// success, returns a pointer to the array of records read, and sets
+// *n to the number of records.  Returns NULL on failure.
+//
+// The file is mapped into memory and split into fields in place, so
+// apart from the array itself, nothing is allocated per record, and
+// reading is about as fast as the file can be read.  Chunks of the
+// file are parsed in parallel with OpenMP, but the records are in the
+// same order as in the file.
+//
+// The file may also be a binary snapshot written by
+// write_records_bin(), in which case this is read_records_bin().
+struct record* read_records(const char *filename, int *n);
+
+// Free records returned by read_records() or read_records_bin().  The
+// 'n' argument must correspond to the number of records, as produced
+// by those functions.
+void free_records(struct record *r, int n);
+
+// A binary snapshot stores the records column by column: each numeric
+// field as an array of 'n' numbers, and each string field as an array
+// of 'n' offsets into a blob of NUL-terminated strings.  Numbers are
+// in native byte order, so a snapshot is only portable between
+// machines with the same endianness.  See record.c for the layout.
+//
+// Nothing in a snapshot has to be parsed, and the strings are used
+// straight from a read-only mapping of the file, so reading a snapshot
+// only costs filling in the numbers and pointers of the records, and
+// the strings are only read from disk when used.
+
+// Write 'n' records as a binary snapshot.  Returns 1 on error and 0 on
+// success.
+int write_records_bin(FILE *f, const struct record *rs, int n);
+
+// Read a binary snapshot.  Like read_records(), returns NULL on
+// failure, and the records must be freed with free_records().
+struct record* read_records_bin(const char *filename, int *n);
+
+#endif
@@ -0,0 +1,41 @@
+// Convert a records file to a binary snapshot, which read_records()
+// (and so every query program) reads much faster than the original
+// file.  See write_records_bin() in record.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "record.h"
+#include "timing.h"
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s FILE SNAPSHOT\n", argv[0]);
+    exit(1);
+  }
+
+  uint64_t start = microseconds();
+  int n;
+  struct record *rs = read_records(argv[1], &n);
+  if (!rs) {
+    fprintf(stderr, "Failed to read records from %s\n", argv[1]);
+    return 1;
+  }
+  printf("Reading records: %dms\n", (int)(microseconds()-start)/1000);
+
+  start = microseconds();
+  FILE *f = fopen(argv[2], "w");
+  // The strings are written one at a time, so a large buffer helps.
+  if (f != NULL) {
+    setvbuf(f, NULL, _IOFBF, 1<<20);
+  }
+  if (f == NULL || write_records_bin(f, rs, n) != 0 || fclose(f) != 0) {
+    fprintf(stderr, "Failed to write snapshot to %s\n", argv[2]);
+    return 1;
+  }
+  printf("Writing snapshot: %dms\n", (int)(microseconds()-start)/1000);
+
+  free_records(rs, n);
+  return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// We need a sorting function that can also accept some auxiliary
+// information - sadly, qsort_r is incompatibly defined on macOS and
+// Linux.
+//
+// This is an introsort: quicksort with a median-of-three (or, for
+// large ranges, median-of-nine) pivot, insertion sort for small
+// ranges, and a switch to heapsort if the recursion gets too deep.
+// It therefore takes O(n log n) time in the worst case, also on
+// sorted or reversed input, uses O(log n) stack space, and never
+// allocates memory.  Like qsort(), it is not stable.
+
+void hpps_quicksort(void *base, size_t nmemb, size_t size,
+                    int (*compar)(const void *, const void *, void *),
+                    void *arg);
+
+// Like hpps_quicksort(), but uses all OpenMP threads.  Mid-sized
+// arrays are sorted by a quicksort that sorts the two sides of each
+// partition as separate tasks.  Large arrays are sorted with sample
+// sort, which distributes the elements into many buckets in a single
+// parallel pass and then sorts the buckets independently; this needs
+// temporary memory of the same size as the array.  Small arrays, and
+// programs compiled without OpenMP, just use hpps_quicksort().
+//
+// 'compar' is called from several threads at once.
+
+void hpps_parallel_sort(void *base, size_t nmemb, size_t size,
+                        int (*compar)(const void *, const void *, void *),
+                        void *arg);
+
+// Sort an array of ints or doubles in ascending order.  These use the
+// same algorithm as hpps_quicksort(), but compare elements directly
+// instead of through a function pointer, which is several times
+// faster.  The doubles must not be NaN.
+
+void hpps_sort_ints(int *base, size_t nmemb);
+
+void hpps_sort_doubles(double *base, size_t nmemb);
+
+// The types of key supported by hpps_radix_sort_keys().
+enum hpps_key_type {
+  HPPS_KEY_INT32,
+  HPPS_KEY_INT64,
+  HPPS_KEY_DOUBLE
+};
+
+// Compute the permutation that sorts 'n' keys in ascending order,
+// without moving the keys themselves: afterwards, 'perm[0]' is the
+// index of the smallest key, and so on.  Equal keys keep their
+// original order.
+//
+// Key 'i' is found 'i*stride' bytes after 'keys', so the keys can be
+// a field of an array of structs, or a coordinate of an array of
+// points (with 'stride' being the size of a point).
+//
+// This is an LSD radix sort on the bits of the keys, which takes
+// O(n) time regardless of the distribution of the keys.  Doubles
+// are ordered by their IEEE representation, which is the usual order
+// except that -0.0 comes before 0.0, and NaNs are placed at the ends.
+// Each pass is parallelised with OpenMP, if available.  Temporary
+// memory of about 24 bytes per key is needed.
+void hpps_radix_sort_keys(const void *keys, size_t n, size_t stride,
+                          enum hpps_key_type type, int *perm);
+
+#endif
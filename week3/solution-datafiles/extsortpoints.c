@@ -0,0 +1,386 @@
+// Sort a points file by the 'c'th coordinate into a new points file,
+// like sortpoints, but without needing the whole file in memory.
+//
+// This is an external merge sort.  The input is read in chunks that
+// fit in the memory budget, and each chunk is sorted and written to a
+// temporary file as a "run".  The runs are then merged, as many at a
+// time as there is room for a large read buffer for each, using a
+// loser tree to find the smallest of the current points.  If there
+// are too many runs, they are merged in several passes.
+//
+// The sort is stable, so the output is exactly the points printed by
+// sortpoints, in the same order.
+
+#define _XOPEN_SOURCE 700
+
+#include "sort.h"
+#include "outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Reads from a run are never smaller than this, so that merging many
+// runs does not degrade into many small reads.
+#define MIN_READ (1<<20)
+
+#define DEFAULT_MEM ((size_t)256<<20)
+
+// A sorted sequence of points in a temporary file.
+struct run {
+  off_t offset;
+  long n;
+};
+
+// The current position in a run during merging.
+struct run_reader {
+  off_t offset;
+  long left;
+  char *buf;
+  size_t len;
+  size_t pos;
+  uint64_t key;
+};
+
+static void die(const char *what) {
+  fprintf(stderr, "%s: %s\n", what, strerror(errno));
+  exit(1);
+}
+
+// Read exactly 'len' bytes at 'offset', retrying on partial reads.
+static void read_at(int fd, void *buf, size_t len, off_t offset) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t got = pread(fd, p, len, offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      die("Failed reading");
+    }
+    if (got == 0) {
+      fprintf(stderr, "Unexpected end of file\n");
+      exit(1);
+    }
+    p += got;
+    offset += got;
+    len -= got;
+  }
+}
+
+// An unsigned integer that orders like the double 'x', as in
+// hpps_radix_sort_keys(), so that runs and merge agree on the order.
+static uint64_t double_key(const char *p) {
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return x >> 63 ? ~x : x | UINT64_C(0x8000000000000000);
+}
+
+// An unlinked temporary file, which disappears when closed.
+static int temp_file(const char *dir) {
+  char *template = malloc(strlen(dir) + 32);
+  if (template == NULL) {
+    die("Failed allocating temporary file name");
+  }
+  sprintf(template, "%s/extsortpoints.XXXXXX", dir);
+  int fd = mkstemp(template);
+  if (fd < 0) {
+    die(template);
+  }
+  unlink(template);
+  free(template);
+  return fd;
+}
+
+// Fill the buffer of 'r' with as many whole points as fit.
+static void run_refill(struct run_reader *r, int fd, size_t record, size_t buf_size) {
+  size_t n = buf_size / record;
+  if ((long)n > r->left) {
+    n = r->left;
+  }
+  read_at(fd, r->buf, n * record, r->offset);
+  r->offset += n * record;
+  r->left -= n;
+  r->len = n * record;
+  r->pos = 0;
+}
+
+// Whether reader 'a' has a smaller point than reader 'b'.  An
+// exhausted reader is larger than everything, and ties go to the
+// earlier run, which keeps the merge stable.
+static int run_less(const struct run_reader *readers, int a, int b) {
+  int a_done = readers[a].pos == readers[a].len;
+  int b_done = readers[b].pos == readers[b].len;
+  if (a_done != b_done) {
+    return b_done;
+  }
+  if (!a_done && readers[a].key != readers[b].key) {
+    return readers[a].key < readers[b].key;
+  }
+  return a < b;
+}
+
+// Merge 'k' consecutive runs from 'in_fd' into one run written to
+// 'out', using 'buf_size' bytes of read buffer per run.
+static void merge_runs(int in_fd, const struct run *runs, int k,
+                       size_t record, int c, size_t buf_size,
+                       char *buffers, struct outbuf *out) {
+  struct run_reader *readers = malloc(k * sizeof(struct run_reader));
+  for (int i = 0; i < k; i++) {
+    readers[i].offset = runs[i].offset;
+    readers[i].left = runs[i].n;
+    readers[i].buf = buffers + (size_t)i * buf_size;
+    run_refill(&readers[i], in_fd, record, buf_size);
+    if (readers[i].len > 0) {
+      readers[i].key = double_key(readers[i].buf + c*sizeof(double));
+    }
+  }
+
+  // The loser tree.  Leaf 'i' is the implicit node k+i, and internal
+  // node j < k holds the run that lost the match played there.
+  // tree[0] holds the overall winner.  Building it plays every match
+  // once, bottom up, with 'winners' holding who won at each node.
+  int *tree = malloc(k * sizeof(int));
+  int *winners = malloc(2 * k * sizeof(int));
+  for (int i = 0; i < k; i++) {
+    winners[k+i] = i;
+  }
+  for (int j = k-1; j >= 1; j--) {
+    int a = winners[2*j];
+    int b = winners[2*j+1];
+    if (run_less(readers, a, b)) {
+      winners[j] = a;
+      tree[j] = b;
+    } else {
+      winners[j] = b;
+      tree[j] = a;
+    }
+  }
+  tree[0] = k > 1 ? winners[1] : 0;
+  free(winners);
+
+  while (1) {
+    int w = tree[0];
+    struct run_reader *r = &readers[w];
+    if (r->pos == r->len) {
+      // The winner is exhausted, so all runs are.
+      break;
+    }
+
+    outbuf_write(out, r->buf + r->pos, record);
+    r->pos += record;
+    if (r->pos == r->len && r->left > 0) {
+      run_refill(r, in_fd, record, buf_size);
+    }
+    if (r->pos < r->len) {
+      r->key = double_key(r->buf + r->pos + c*sizeof(double));
+    }
+
+    // Replay the matches from the leaf of 'w' to the root.  Only 'w'
+    // has changed, so each match is against the stored loser.
+    for (int j = (k+w)/2; j >= 1; j /= 2) {
+      if (run_less(readers, tree[j], w)) {
+        int loser = w;
+        w = tree[j];
+        tree[j] = loser;
+      }
+    }
+    tree[0] = w;
+  }
+
+  free(tree);
+  free(readers);
+}
+
+// Parse a size such as "512M".
+static size_t parse_size(const char *s) {
+  char *end;
+  double x = strtod(s, &end);
+  switch (*end) {
+  case 'G': case 'g': x *= 1024;
+    // fall through
+  case 'M': case 'm': x *= 1024;
+    // fall through
+  case 'K': case 'k': x *= 1024; end++;
+    // fall through
+  case '\0': break;
+  default: x = -1;
+  }
+  if (*end != '\0' || x <= 0) {
+    return 0;
+  }
+  return (size_t)x;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "Usage: %s [--mem <bytes>] [--tmpdir <dir>] <points> <c> <output>\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  size_t mem = DEFAULT_MEM;
+  const char *tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL) {
+    tmpdir = "/tmp";
+  }
+
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    if (strcmp(argv[argi], "--mem") == 0 && argi+1 < argc) {
+      mem = parse_size(argv[++argi]);
+      if (mem == 0) {
+        usage(argv[0]);
+      }
+    } else if (strcmp(argv[argi], "--tmpdir") == 0 && argi+1 < argc) {
+      tmpdir = argv[++argi];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (argc - argi != 3) {
+    usage(argv[0]);
+  }
+  const char *input_fname = argv[argi];
+  int c = atoi(argv[argi+1]);
+  const char *output_fname = argv[argi+2];
+
+  int input_fd = open(input_fname, O_RDONLY);
+  if (input_fd < 0) {
+    die(input_fname);
+  }
+  int32_t header[2];
+  read_at(input_fd, header, sizeof(header), 0);
+  int32_t n = header[0];
+  int32_t d = header[1];
+  if (n < 0 || d < 1 || c < 0 || c >= d) {
+    fprintf(stderr, "Invalid header or coordinate\n");
+    exit(1);
+  }
+  size_t record = d * sizeof(double);
+
+  // Sorting a run needs the points twice (before and after permuting)
+  // plus the permutation and the temporary memory of the radix sort.
+  size_t run_max = mem / (2*record + 28);
+  if (run_max > INT32_MAX) {
+    run_max = INT32_MAX;
+  }
+  if (run_max < 1) {
+    fprintf(stderr, "--mem is too small for even a single point\n");
+    exit(1);
+  }
+
+  struct outbuf out;
+  if (outbuf_open(&out, output_fname, 0) != 0) {
+    die(output_fname);
+  }
+  outbuf_write(&out, header, sizeof(header));
+
+  // Phase 1: sorted runs.  If everything fits in one run, it goes
+  // straight to the output.
+  int n_runs = (n + run_max - 1) / run_max;
+  size_t run_len = n_runs > 1 ? run_max : (size_t)n;
+  struct run *runs = malloc((n_runs > 0 ? n_runs : 1) * sizeof(struct run));
+  int run_fd = n_runs > 1 ? temp_file(tmpdir) : -1;
+  struct outbuf run_out;
+  if (n_runs > 1 && outbuf_fd(&run_out, run_fd) != 0) {
+    die("Failed allocating buffer");
+  }
+
+  char *unsorted = malloc(run_len * record);
+  char *sorted = malloc(run_len * record);
+  int *perm = malloc(run_len * sizeof(int));
+
+  off_t offset = 0;
+  for (int i = 0; i < n_runs; i++) {
+    long m = n - (long)i*(long)run_max;
+    if (m > (long)run_max) {
+      m = run_max;
+    }
+    read_at(input_fd, unsorted, m * record, sizeof(header) + (off_t)i*run_max*record);
+
+    hpps_radix_sort_keys(unsorted + c*sizeof(double), m, record,
+                         HPPS_KEY_DOUBLE, perm);
+    for (long j = 0; j < m; j++) {
+      memcpy(sorted + j*record, unsorted + (size_t)perm[j]*record, record);
+    }
+
+    outbuf_write(n_runs > 1 ? &run_out : &out, sorted, m * record);
+    runs[i].offset = offset;
+    runs[i].n = m;
+    offset += m * record;
+  }
+  close(input_fd);
+  free(perm);
+  free(sorted);
+  free(unsorted);
+
+  if (n_runs > 1) {
+    if (outbuf_close(&run_out) != 0) {
+      die("Failed writing run");
+    }
+  }
+
+  // Phase 2: merge, with one read buffer per run of at least MIN_READ
+  // bytes, but always at least two runs at a time.
+  size_t min_buf = MIN_READ > record ? MIN_READ - MIN_READ % record : record;
+  int fan_in = mem / min_buf;
+  if (fan_in < 2) {
+    fan_in = 2;
+  }
+
+  while (n_runs > 1) {
+    int k = n_runs < fan_in ? n_runs : fan_in;
+    size_t buf_size = mem / k;
+    buf_size -= buf_size % record;
+    if (buf_size < record) {
+      buf_size = record;
+    }
+    char *buffers = malloc((size_t)k * buf_size);
+
+    if (n_runs <= fan_in) {
+      merge_runs(run_fd, runs, n_runs, record, c, buf_size, buffers, &out);
+      n_runs = 0;
+    } else {
+      // Merge groups of 'fan_in' runs into a new temporary file.
+      int next_fd = temp_file(tmpdir);
+      struct outbuf next_out;
+      if (outbuf_fd(&next_out, next_fd) != 0) {
+        die("Failed allocating buffer");
+      }
+      int n_next = 0;
+      offset = 0;
+      for (int i = 0; i < n_runs; i += fan_in) {
+        int group = n_runs - i < fan_in ? n_runs - i : fan_in;
+        long m = 0;
+        for (int j = 0; j < group; j++) {
+          m += runs[i+j].n;
+        }
+        merge_runs(run_fd, &runs[i], group, record, c, buf_size, buffers, &next_out);
+        runs[n_next].offset = offset;
+        runs[n_next].n = m;
+        offset += m * record;
+        n_next++;
+      }
+      if (outbuf_close(&next_out) != 0) {
+        die("Failed writing run");
+      }
+      close(run_fd);
+      run_fd = next_fd;
+      n_runs = n_next;
+    }
+    free(buffers);
+  }
+
+  if (run_fd >= 0) {
+    close(run_fd);
+  }
+  free(runs);
+
+  if (outbuf_close(&out) != 0) {
+    die(output_fname);
+  }
+  return 0;
+}
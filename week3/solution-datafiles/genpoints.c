@@ -1,35 +1,72 @@
 #include "io.h"
+#include "prng.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
+#include <omp.h>
+
+// Points are generated in chunks of about this many coordinates,
+// several chunks at a time in parallel, and written out before the
+// next chunks are generated.  Chunk 'i' comes from the random stream
+// obtained by jumping 'i' times from the seed, so the result only
+// depends on the seed, not on the number of threads.
+#define CHUNK_VALUES (1<<20)
 
 int main(int argc, char** argv) {
-  if (argc != 4) {
-    fprintf(stderr, "Usage: %s <n> <d> <points>\n", argv[0]);
+  int have_seed = argc == 6 && strcmp(argv[1], "--seed") == 0;
+  if (argc != 4 && !have_seed) {
+    fprintf(stderr, "Usage: %s [--seed <seed>] <n> <d> <points>\n", argv[0]);
     exit(1);
   }
 
-  int32_t n = atoi(argv[1]);
-  int32_t d = atoi(argv[2]);
-  FILE *points_f = fopen(argv[3], "w");
+  int32_t n = atoi(argv[argc-3]);
+  int32_t d = atoi(argv[argc-2]);
+  FILE *points_f = fopen(argv[argc-1], "w");
   assert(points_f != NULL);
+  assert(n >= 0 && d > 0);
+
+  uint64_t seed = have_seed ? strtoull(argv[2], NULL, 10) : (uint64_t)time(NULL);
+
+  // The header, followed by the points chunk by chunk.
+  int ok = fwrite(&n, sizeof(int32_t), 1, points_f) == 1
+    && fwrite(&d, sizeof(int32_t), 1, points_f) == 1;
+  assert(ok);
 
-  srand(time(NULL));
+  int threads = omp_get_max_threads();
+  long chunk_points = CHUNK_VALUES / d > 0 ? CHUNK_VALUES / d : 1;
+  long n_chunks = (n + chunk_points - 1) / chunk_points;
 
-  double *data = malloc(n*d*sizeof(double));
+  double *data = malloc(threads * chunk_points * d * sizeof(double));
+  struct prng *streams = malloc(threads * sizeof(struct prng));
 
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < d; j++) {
-      double x = ((double)rand())/RAND_MAX;
-      data[i*d+j] = x;
+  struct prng stream;
+  prng_seed(&stream, seed);
+
+  for (long first = 0; first < n_chunks; first += threads) {
+    int m = n_chunks - first < threads ? n_chunks - first : threads;
+    for (int t = 0; t < m; t++) {
+      streams[t] = stream;
+      prng_jump(&stream);
     }
-  }
 
-  int err = write_points(points_f, n, d, data);
-  assert(err == 0);
+    long start = first * chunk_points;
+    long count = n - start < m * chunk_points ? n - start : m * chunk_points;
+
+#pragma omp parallel for
+    for (int t = 0; t < m; t++) {
+      long lo = t * chunk_points;
+      long hi = lo + chunk_points < count ? lo + chunk_points : count;
+      prng_doubles(&streams[t], &data[lo*d], (hi-lo) * d);
+    }
+
+    ok = fwrite(data, d*sizeof(double), count, points_f) == (size_t)count;
+    assert(ok);
+  }
 
   fclose(points_f);
+  free(streams);
   free(data);
 }
@@ -0,0 +1,68 @@
+#include "prng.h"
+
+static inline uint64_t rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t next(uint64_t *s) {
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+// The state must not be all zeroes, so it is filled from the seed with
+// splitmix64, which never produces four zeroes in a row.
+void prng_seed(struct prng *r, uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t z = (seed += UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+    r->s[i] = z ^ (z >> 31);
+  }
+}
+
+void prng_jump(struct prng *r) {
+  static const uint64_t jump[4] = {
+    UINT64_C(0x180ec6d33cfd0aba), UINT64_C(0xd5a61266f0c9392c),
+    UINT64_C(0xa9582618e03fc9aa), UINT64_C(0x39abdc4529b1661c)
+  };
+
+  uint64_t s[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 4; i++) {
+    for (int b = 0; b < 64; b++) {
+      if (jump[i] & (UINT64_C(1) << b)) {
+        for (int j = 0; j < 4; j++) {
+          s[j] ^= r->s[j];
+        }
+      }
+      next(r->s);
+    }
+  }
+  for (int j = 0; j < 4; j++) {
+    r->s[j] = s[j];
+  }
+}
+
+uint64_t prng_next(struct prng *r) {
+  return next(r->s);
+}
+
+void prng_doubles(struct prng *r, double *out, size_t n) {
+  // Keep the state in locals, so the compiler need not store it after
+  // every number.
+  uint64_t s[4] = {r->s[0], r->s[1], r->s[2], r->s[3]};
+  for (size_t i = 0; i < n; i++) {
+    out[i] = (next(s) >> 11) * 0x1.0p-53;
+  }
+  for (int j = 0; j < 4; j++) {
+    r->s[j] = s[j];
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef KNN_PRNG_H
+#define KNN_PRNG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The xoshiro256** pseudo-random number generator by Blackman and
+// Vigna.  Unlike rand(), its state is explicit, so every thread can
+// have its own, and it can jump ahead by 2^128 numbers in constant
+// time.  Jumping therefore splits one seed into many streams that are
+// guaranteed not to overlap in practice, which is how parallel
+// generators stay reproducible regardless of the number of threads.
+struct prng {
+  uint64_t s[4];
+};
+
+// Initialise 'r' from a 64-bit seed.  Any seed is fine, including 0.
+void prng_seed(struct prng *r, uint64_t seed);
+
+// Advance 'r' by 2^128 numbers.
+void prng_jump(struct prng *r);
+
+// The next 64 random bits.
+uint64_t prng_next(struct prng *r);
+
+// Fill 'out' with 'n' doubles uniformly distributed in [0,1), each
+// with 53 random bits.
+void prng_doubles(struct prng *r, double *out, size_t n);
+
+#endif
@@ -3,55 +3,633 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
 
-static void* idx(void* base, size_t size, int i) {
-  return ((unsigned char*)base)+i*size;
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Ranges with at most this many elements are insertion sorted.
+#define INSERTION_SORT_MAX 16
+
+// Ranges with more elements than this use the median of three
+// medians of three as pivot (Tukey's ninther), rather than just the
+// median of three.
+#define NINTHER_MIN 128
+
+// Maximum recursion depth before falling back to heapsort, for 'n'
+// elements: 2*log2(n).
+static int depth_limit(size_t n) {
+  int depth = 0;
+  while (n > 1) {
+    n /= 2;
+    depth += 2;
+  }
+  return depth;
+}
+
+// The generic version, where elements are 'size' bytes compared with
+// 'compar'.  Elements are only ever swapped, never copied out of the
+// array, so no temporary storage is needed.
+
+struct sort_ctx {
+  unsigned char *base;
+  size_t size;
+  int (*compar)(const void *, const void *, void *);
+  void *arg;
+};
+
+static void* idx(const struct sort_ctx *ctx, size_t i) {
+  return ctx->base + i*ctx->size;
+}
+
+static int cmp(const struct sort_ctx *ctx, size_t i, size_t j) {
+  return ctx->compar(idx(ctx, i), idx(ctx, j), ctx->arg);
+}
+
+static void swap(const struct sort_ctx *ctx, size_t i, size_t j) {
+  unsigned char *x = idx(ctx, i);
+  unsigned char *y = idx(ctx, j);
+  size_t size = ctx->size;
+
+  // Common element sizes get a single fixed-size copy each way.
+  if (size == 4) {
+    unsigned char tmp[4];
+    memcpy(tmp, x, 4); memcpy(x, y, 4); memcpy(y, tmp, 4);
+  } else if (size == 8) {
+    unsigned char tmp[8];
+    memcpy(tmp, x, 8); memcpy(x, y, 8); memcpy(y, tmp, 8);
+  } else {
+    unsigned char tmp[64];
+    while (size > 0) {
+      size_t n = size < sizeof(tmp) ? size : sizeof(tmp);
+      memcpy(tmp, x, n); memcpy(x, y, n); memcpy(y, tmp, n);
+      x += n;
+      y += n;
+      size -= n;
+    }
+  }
+}
+
+// Index of the median of elements 'i', 'j' and 'k'.
+static size_t median3(const struct sort_ctx *ctx, size_t i, size_t j, size_t k) {
+  if (cmp(ctx, i, j) < 0) {
+    if (cmp(ctx, j, k) < 0) {
+      return j;
+    }
+    return cmp(ctx, i, k) < 0 ? k : i;
+  } else {
+    if (cmp(ctx, i, k) < 0) {
+      return i;
+    }
+    return cmp(ctx, j, k) < 0 ? k : j;
+  }
 }
 
-int partition(void *a, size_t size,
-                   int (*compar)(const void *, const void *, void *),
-                   void *arg,
-                   int p, int r) {
-  void *tmp = malloc(size);
-  void *pivot = malloc(size);
+static void insertion_sort(const struct sort_ctx *ctx, size_t lo, size_t hi) {
+  for (size_t i = lo+1; i < hi; i++) {
+    for (size_t j = i; j > lo && cmp(ctx, j-1, j) > 0; j--) {
+      swap(ctx, j-1, j);
+    }
+  }
+}
 
-  // Would be better to pick pivot randomly.
-  memcpy(pivot, idx(a, size, p), size);
+static void sift_down(const struct sort_ctx *ctx, size_t lo, size_t i, size_t n) {
+  while (2*i+1 < n) {
+    size_t c = 2*i+1;
+    if (c+1 < n && cmp(ctx, lo+c, lo+c+1) < 0) {
+      c++;
+    }
+    if (cmp(ctx, lo+i, lo+c) >= 0) {
+      return;
+    }
+    swap(ctx, lo+i, lo+c);
+    i = c;
+  }
+}
 
-  int i=p-1;
-  int j=r;
+static void heapsort(const struct sort_ctx *ctx, size_t lo, size_t hi) {
+  size_t n = hi - lo;
+  for (size_t i = n/2; i > 0; i--) {
+    sift_down(ctx, lo, i-1, n);
+  }
+  for (size_t end = n-1; end > 0; end--) {
+    swap(ctx, lo, lo+end);
+    sift_down(ctx, lo, 0, end);
+  }
+}
 
+// Partition the range around the element at 'lo', and return the
+// final position of that element.  Elements equal to the pivot stop
+// both scans, which keeps the halves balanced when there are many
+// duplicates.
+static size_t partition(const struct sort_ctx *ctx, size_t lo, size_t hi) {
+  size_t i = lo;
+  size_t j = hi;
   while (1) {
-    do { j--; } while (compar(pivot, idx(a, size, j), arg) < 0);
-    do { i++; } while (compar(idx(a, size, i), pivot, arg) < 0);
-    if (i < j) {
-      memcpy(tmp, idx(a, size, i), size);
-      memcpy(idx(a, size, i), idx(a, size, j), size);
-      memcpy(idx(a, size, j), tmp, size);
-    } else {
-      free(tmp);
-      free(pivot);
-      return j+1;
+    do { i++; } while (i < hi-1 && cmp(ctx, i, lo) < 0);
+    do { j--; } while (j > lo && cmp(ctx, lo, j) < 0);
+    if (i >= j) {
+      break;
     }
+    swap(ctx, i, j);
   }
+  swap(ctx, lo, j);
+  return j;
 }
 
-static void quicksort(int* a, size_t size,
-                      int (*compar)(const void *, const void *, void *),
-                      void *arg,
-                      int start, int end) {
-  if (end-start<2) {
-    return;
+static void introsort(const struct sort_ctx *ctx, size_t lo, size_t hi, int depth) {
+  while (hi - lo > INSERTION_SORT_MAX) {
+    if (depth-- == 0) {
+      heapsort(ctx, lo, hi);
+      return;
+    }
+
+    size_t n = hi - lo;
+    size_t mid = lo + n/2;
+    size_t pivot;
+    if (n > NINTHER_MIN) {
+      size_t s = n/8;
+      pivot = median3(ctx,
+                      median3(ctx, lo, lo+s, lo+2*s),
+                      median3(ctx, mid-s, mid, mid+s),
+                      median3(ctx, hi-1-2*s, hi-1-s, hi-1));
+    } else {
+      pivot = median3(ctx, lo, mid, hi-1);
+    }
+    swap(ctx, lo, pivot);
+
+    size_t p = partition(ctx, lo, hi);
+
+    // Recurse on the smaller side and loop on the larger, so the stack
+    // depth is at most log2(n).
+    if (p - lo < hi - (p+1)) {
+      introsort(ctx, lo, p, depth);
+      lo = p+1;
+    } else {
+      introsort(ctx, p+1, hi, depth);
+      hi = p;
+    }
   }
 
-  int q = partition(a, size, compar, arg, start, end);
-  quicksort(a, size, compar, arg, start, q);
-  quicksort(a, size, compar, arg, q, end);
+  insertion_sort(ctx, lo, hi);
 }
 
 void hpps_quicksort(void *base, size_t nmemb, size_t size,
                     int (*compar)(const void *, const void *, void *),
                     void *arg) {
-  quicksort(base, size, compar, arg, 0, nmemb);
+  struct sort_ctx ctx = { base, size, compar, arg };
+  introsort(&ctx, 0, nmemb, depth_limit(nmemb));
+}
+
+// Arrays smaller than this are not worth sorting in parallel.
+#define PARALLEL_MIN (1<<14)
+
+#ifdef _OPENMP
+
+// Partitions smaller than this are sorted by a single task.
+#define TASK_MIN (1<<13)
+
+// Arrays at least this large use sample sort.
+#define SAMPLE_SORT_MIN (1<<20)
+
+// Sample sort uses this many buckets per thread, such that buckets
+// of uneven size still balance out, and takes this many samples per
+// bucket to choose the splitters.
+#define BUCKETS_PER_THREAD 4
+#define OVERSAMPLING 32
+
+// Quicksort where the smaller side of each partition becomes a new
+// task.  Must be called from within a parallel region.
+static void parallel_introsort(const struct sort_ctx *ctx, size_t lo, size_t hi, int depth) {
+  while (hi - lo > TASK_MIN) {
+    if (depth-- == 0) {
+      heapsort(ctx, lo, hi);
+      return;
+    }
+
+    size_t n = hi - lo;
+    size_t mid = lo + n/2;
+    size_t s = n/8;
+    size_t pivot = median3(ctx,
+                           median3(ctx, lo, lo+s, lo+2*s),
+                           median3(ctx, mid-s, mid, mid+s),
+                           median3(ctx, hi-1-2*s, hi-1-s, hi-1));
+    swap(ctx, lo, pivot);
+
+    size_t p = partition(ctx, lo, hi);
+
+    if (p - lo < hi - (p+1)) {
+#pragma omp task firstprivate(lo, p, depth)
+      parallel_introsort(ctx, lo, p, depth);
+      lo = p+1;
+    } else {
+#pragma omp task firstprivate(hi, p, depth)
+      parallel_introsort(ctx, p+1, hi, depth);
+      hi = p;
+    }
+  }
+
+  introsort(ctx, lo, hi, depth);
+}
+
+// The bucket of an element: the number of splitters that are not
+// greater than it.
+static int find_bucket(const struct sort_ctx *ctx, const void *x,
+                       const unsigned char *splitters, int n_splitters) {
+  int lo = 0;
+  int hi = n_splitters;
+  while (lo < hi) {
+    int mid = lo + (hi-lo)/2;
+    if (ctx->compar(x, splitters + mid*ctx->size, ctx->arg) < 0) {
+      hi = mid;
+    } else {
+      lo = mid+1;
+    }
+  }
+  return lo;
 }
 
+static void sample_sort(const struct sort_ctx *ctx, size_t n) {
+  size_t size = ctx->size;
+  int threads = omp_get_max_threads();
+  int n_buckets = threads * BUCKETS_PER_THREAD;
+  int n_splitters = n_buckets - 1;
+
+  // Choose splitters from a sorted sample, taken at pseudo-random
+  // positions so that patterns in the input do not matter.
+  int n_samples = n_buckets * OVERSAMPLING;
+  unsigned char *samples = malloc((size_t)n_samples * size);
+  uint64_t state = 0x9e3779b97f4a7c15;
+  for (int i = 0; i < n_samples; i++) {
+    state = state * 6364136223846793005 + 1442695040888963407;
+    memcpy(samples + i*size, idx(ctx, (state >> 33) % n), size);
+  }
+  hpps_quicksort(samples, n_samples, size, ctx->compar, ctx->arg);
+
+  unsigned char *splitters = malloc((size_t)(n_splitters > 0 ? n_splitters : 1) * size);
+  for (int i = 0; i < n_splitters; i++) {
+    memcpy(splitters + i*size, samples + (size_t)(i+1)*OVERSAMPLING*size, size);
+  }
+  free(samples);
+
+  // counts[t*n_buckets+b] is the number of elements in thread t's
+  // part of the array that belong in bucket b.
+  uint16_t *buckets = malloc(n * sizeof(uint16_t));
+  size_t *counts = calloc((size_t)threads * n_buckets, sizeof(size_t));
+  size_t *bucket_start = malloc((n_buckets+1) * sizeof(size_t));
+  unsigned char *tmp = malloc(n * size);
+
+#pragma omp parallel num_threads(threads)
+  {
+    // Every thread handles the same part of the array in both passes.
+    int t = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+    size_t lo = n * t / nt;
+    size_t hi = n * (t+1) / nt;
+    size_t *my_counts = &counts[(size_t)t*n_buckets];
+
+    for (size_t i = lo; i < hi; i++) {
+      int b = find_bucket(ctx, idx(ctx, i), splitters, n_splitters);
+      buckets[i] = b;
+      my_counts[b]++;
+    }
+
+#pragma omp barrier
+
+    // Turn the counts into offsets: bucket by bucket, and within each
+    // bucket, thread by thread.
+#pragma omp single
+    {
+      size_t offset = 0;
+      for (int b = 0; b < n_buckets; b++) {
+        bucket_start[b] = offset;
+        for (int u = 0; u < nt; u++) {
+          size_t count = counts[(size_t)u*n_buckets+b];
+          counts[(size_t)u*n_buckets+b] = offset;
+          offset += count;
+        }
+      }
+      bucket_start[n_buckets] = offset;
+    }
+
+    for (size_t i = lo; i < hi; i++) {
+      memcpy(tmp + (my_counts[buckets[i]]++)*size, idx(ctx, i), size);
+    }
+
+#pragma omp barrier
+
+    // Copy back, and sort each bucket in place.  A bucket may be much
+    // larger than the others if there are many equal elements, so
+    // buckets are sorted with parallel_introsort() to split them up.
+    memcpy(idx(ctx, lo), tmp + lo*size, (hi-lo)*size);
+
+#pragma omp barrier
+
+#pragma omp single
+    for (int b = 0; b < n_buckets; b++) {
+#pragma omp task firstprivate(b)
+      parallel_introsort(ctx, bucket_start[b], bucket_start[b+1],
+                         depth_limit(bucket_start[b+1] - bucket_start[b]));
+    }
+  }
+
+  free(tmp);
+  free(bucket_start);
+  free(counts);
+  free(buckets);
+  free(splitters);
+}
+
+void hpps_parallel_sort(void *base, size_t nmemb, size_t size,
+                        int (*compar)(const void *, const void *, void *),
+                        void *arg) {
+  struct sort_ctx ctx = { base, size, compar, arg };
+
+  if (nmemb < PARALLEL_MIN || omp_get_max_threads() == 1 || omp_in_parallel()) {
+    introsort(&ctx, 0, nmemb, depth_limit(nmemb));
+  } else if (nmemb < SAMPLE_SORT_MIN) {
+#pragma omp parallel
+#pragma omp single
+    parallel_introsort(&ctx, 0, nmemb, depth_limit(nmemb));
+  } else {
+    sample_sort(&ctx, nmemb);
+  }
+}
+
+#else
+
+void hpps_parallel_sort(void *base, size_t nmemb, size_t size,
+                        int (*compar)(const void *, const void *, void *),
+                        void *arg) {
+  hpps_quicksort(base, nmemb, size, compar, arg);
+}
+
+#endif
+
+// The typed versions are the same algorithm, instantiated for each
+// element type by this macro, with 'a < b' instead of 'compar'.
+
+#define DEFINE_INTROSORT(NAME, T)                                       \
+  static void NAME##_swap(T *a, size_t i, size_t j) {                   \
+    T tmp = a[i];                                                       \
+    a[i] = a[j];                                                        \
+    a[j] = tmp;                                                         \
+  }                                                                     \
+                                                                        \
+  static size_t NAME##_median3(const T *a, size_t i, size_t j, size_t k) { \
+    if (a[i] < a[j]) {                                                  \
+      if (a[j] < a[k]) {                                                \
+        return j;                                                       \
+      }                                                                 \
+      return a[i] < a[k] ? k : i;                                       \
+    } else {                                                            \
+      if (a[i] < a[k]) {                                                \
+        return i;                                                       \
+      }                                                                 \
+      return a[j] < a[k] ? k : j;                                       \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static void NAME##_insertion_sort(T *a, size_t lo, size_t hi) {       \
+    for (size_t i = lo+1; i < hi; i++) {                                \
+      T x = a[i];                                                       \
+      size_t j = i;                                                     \
+      for (; j > lo && x < a[j-1]; j--) {                               \
+        a[j] = a[j-1];                                                  \
+      }                                                                 \
+      a[j] = x;                                                         \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static void NAME##_sift_down(T *a, size_t i, size_t n) {              \
+    while (2*i+1 < n) {                                                 \
+      size_t c = 2*i+1;                                                 \
+      if (c+1 < n && a[c] < a[c+1]) {                                   \
+        c++;                                                            \
+      }                                                                 \
+      if (!(a[i] < a[c])) {                                             \
+        return;                                                         \
+      }                                                                 \
+      NAME##_swap(a, i, c);                                             \
+      i = c;                                                            \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static void NAME##_heapsort(T *a, size_t n) {                         \
+    for (size_t i = n/2; i > 0; i--) {                                  \
+      NAME##_sift_down(a, i-1, n);                                      \
+    }                                                                   \
+    for (size_t end = n-1; end > 0; end--) {                            \
+      NAME##_swap(a, 0, end);                                           \
+      NAME##_sift_down(a, 0, end);                                      \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  static void NAME##_introsort(T *a, size_t lo, size_t hi, int depth) { \
+    while (hi - lo > INSERTION_SORT_MAX) {                              \
+      if (depth-- == 0) {                                               \
+        NAME##_heapsort(a+lo, hi-lo);                                   \
+        return;                                                         \
+      }                                                                 \
+                                                                        \
+      size_t n = hi - lo;                                               \
+      size_t mid = lo + n/2;                                            \
+      size_t pivot;                                                     \
+      if (n > NINTHER_MIN) {                                            \
+        size_t s = n/8;                                                 \
+        pivot = NAME##_median3(a,                                       \
+                               NAME##_median3(a, lo, lo+s, lo+2*s),     \
+                               NAME##_median3(a, mid-s, mid, mid+s),    \
+                               NAME##_median3(a, hi-1-2*s, hi-1-s, hi-1)); \
+      } else {                                                          \
+        pivot = NAME##_median3(a, lo, mid, hi-1);                       \
+      }                                                                 \
+      NAME##_swap(a, lo, pivot);                                        \
+                                                                        \
+      T v = a[lo];                                                      \
+      size_t i = lo;                                                    \
+      size_t j = hi;                                                    \
+      while (1) {                                                       \
+        do { i++; } while (i < hi-1 && a[i] < v);                       \
+        do { j--; } while (j > lo && v < a[j]);                         \
+        if (i >= j) {                                                   \
+          break;                                                        \
+        }                                                               \
+        NAME##_swap(a, i, j);                                           \
+      }                                                                 \
+      NAME##_swap(a, lo, j);                                            \
+                                                                        \
+      if (j - lo < hi - (j+1)) {                                        \
+        NAME##_introsort(a, lo, j, depth);                              \
+        lo = j+1;                                                       \
+      } else {                                                          \
+        NAME##_introsort(a, j+1, hi, depth);                            \
+        hi = j;                                                         \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    NAME##_insertion_sort(a, lo, hi);                                   \
+  }
+
+DEFINE_INTROSORT(ints, int)
+DEFINE_INTROSORT(doubles, double)
+
+void hpps_sort_ints(int *base, size_t nmemb) {
+  ints_introsort(base, 0, nmemb, depth_limit(nmemb));
+}
+
+void hpps_sort_doubles(double *base, size_t nmemb) {
+  doubles_introsort(base, 0, nmemb, depth_limit(nmemb));
+}
+
+// Radix sort.  The keys are first converted to unsigned integers that
+// compare the same way, and then sorted one byte at a time, starting
+// with the least significant.
+
+#define RADIX_BITS 8
+#define RADIX (1<<RADIX_BITS)
+
+// Flip the sign bit of integers so that negative numbers come first.
+// For doubles, also flip all other bits of negative numbers, as they
+// are stored as sign and magnitude.
+static uint64_t radix_key(const unsigned char *p, enum hpps_key_type type) {
+  switch (type) {
+  case HPPS_KEY_INT32: {
+    int32_t x;
+    memcpy(&x, p, sizeof(x));
+    return (uint32_t)x ^ UINT32_C(0x80000000);
+  }
+  case HPPS_KEY_INT64: {
+    int64_t x;
+    memcpy(&x, p, sizeof(x));
+    return (uint64_t)x ^ UINT64_C(0x8000000000000000);
+  }
+  case HPPS_KEY_DOUBLE: {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x >> 63 ? ~x : x | UINT64_C(0x8000000000000000);
+  }
+  }
+  return 0;
+}
+
+void hpps_radix_sort_keys(const void *keys, size_t n, size_t stride,
+                          enum hpps_key_type type, int *perm) {
+  int passes = (type == HPPS_KEY_INT32 ? 32 : 64) / RADIX_BITS;
+
+#ifdef _OPENMP
+  int threads = n < PARALLEL_MIN ? 1 : omp_get_max_threads();
+#else
+  int threads = 1;
+#endif
+
+  uint64_t *key_a = malloc(n * sizeof(uint64_t));
+  uint64_t *key_b = malloc(n * sizeof(uint64_t));
+  int *perm_b = malloc(n * sizeof(int));
+
+  // counts[t*RADIX+r] is the number of keys with digit 'r' in thread
+  // t's part of the array, and later where thread 't' puts the next
+  // such key.
+  size_t *counts = malloc((size_t)threads * RADIX * sizeof(size_t));
+
+  // Which passes can be skipped because all keys have the same digit.
+  // For example, doubles of similar magnitude share their top bytes.
+  int skip[64 / RADIX_BITS];
+
+  // The keys and indexes are sorted back and forth between the
+  // 'a' and 'b' arrays.
+  uint64_t *key_in = key_a;
+  uint64_t *key_out = key_b;
+  int *perm_in = perm;
+  int *perm_out = perm_b;
+
+#pragma omp parallel num_threads(threads)
+  {
+#ifdef _OPENMP
+    int t = omp_get_thread_num();
+    int nt = omp_get_num_threads();
+#else
+    int t = 0;
+    int nt = 1;
+#endif
+    size_t lo = n * t / nt;
+    size_t hi = n * (t+1) / nt;
+    size_t *my_counts = &counts[(size_t)t*RADIX];
+
+    for (size_t i = lo; i < hi; i++) {
+      key_a[i] = radix_key((const unsigned char*)keys + i*stride, type);
+      perm[i] = i;
+    }
+
+    for (int pass = 0; pass < passes; pass++) {
+      int shift = pass * RADIX_BITS;
+
+      // Local copies of the shared pointers, so the compiler need not
+      // reload them after every store.
+      const uint64_t *kin = key_in;
+      const int *pin = perm_in;
+      uint64_t *kout = key_out;
+      int *pout = perm_out;
+
+      for (int r = 0; r < RADIX; r++) {
+        my_counts[r] = 0;
+      }
+      for (size_t i = lo; i < hi; i++) {
+        my_counts[(kin[i] >> shift) & (RADIX-1)]++;
+      }
+
+#pragma omp barrier
+
+      // Offsets by digit, and within a digit by thread, which keeps
+      // the sort stable.
+#pragma omp single
+      {
+        size_t offset = 0;
+        skip[pass] = 0;
+        for (int r = 0; r < RADIX; r++) {
+          size_t total = 0;
+          for (int u = 0; u < nt; u++) {
+            size_t count = counts[(size_t)u*RADIX+r];
+            counts[(size_t)u*RADIX+r] = offset;
+            offset += count;
+            total += count;
+          }
+          if (total == n) {
+            skip[pass] = 1;
+          }
+        }
+      }
+
+      if (!skip[pass]) {
+        for (size_t i = lo; i < hi; i++) {
+          size_t j = my_counts[(kin[i] >> shift) & (RADIX-1)]++;
+          kout[j] = kin[i];
+          pout[j] = pin[i];
+        }
+
+#pragma omp barrier
+
+#pragma omp single
+        {
+          uint64_t *key_tmp = key_in;
+          key_in = key_out;
+          key_out = key_tmp;
+          int *perm_tmp = perm_in;
+          perm_in = perm_out;
+          perm_out = perm_tmp;
+        }
+      }
+    }
+
+    // The result may have ended up in the temporary array.
+    if (perm_in != perm) {
+      memcpy(&perm[lo], &perm_in[lo], (hi-lo) * sizeof(int));
+    }
+  }
+
+  free(counts);
+  free(perm_b);
+  free(key_b);
+  free(key_a);
+}
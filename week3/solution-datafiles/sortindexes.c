@@ -1,8 +1,10 @@
 #include "io.h"
 #include "sort.h"
+#include "outbuf.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <unistd.h>
 
 struct sort_env {
   int c;
@@ -55,17 +57,27 @@ int main(int argc, char** argv) {
   env.d = d;
   env.c = c;
 
+  // Printing with printf() is slower than the sorting, so the output
+  // is formatted by hand and buffered.
+  struct outbuf out;
+  int err = outbuf_fd(&out, STDOUT_FILENO);
+  assert(err == 0);
+
   for (int i = 0; i < n_indexes; i++) {
     hpps_quicksort(&indexes[i*k], k, sizeof(int),
                    (int (*)(const void*, const void*, void*))cmp_indexes,
                    &env);
-    printf("Indexes: ");
+    outbuf_str(&out, "Indexes: ");
     for (int j = 0; j < k; j++) {
-      printf("%d ", indexes[i*k+j]);
+      outbuf_int(&out, indexes[i*k+j]);
+      outbuf_char(&out, ' ');
     }
-    printf("\n");
+    outbuf_char(&out, '\n');
   }
 
+  err = outbuf_close(&out);
+  assert(err == 0);
+
   free(points);
   free(indexes);
 }
@@ -4,18 +4,6 @@
 #include <stdlib.h>
 #include <assert.h>
 
-int cmp_points(const double *x, const double *y, int* cp) {
-  int c = *cp;
-
-  if (x[c] < y[c]) {
-    return -1;
-  } else if (x[c] == y[c]) {
-    return 0;
-  } else {
-    return 1;
-  }
-}
-
 int main(int argc, char** argv) {
   if (argc != 3) {
     fprintf(stderr, "Usage: %s <points> <c>\n", argv[0]);
@@ -33,17 +21,22 @@ int main(int argc, char** argv) {
 
   assert(c >= 0 && c < d);
 
-  hpps_quicksort(points, n_points, d*sizeof(double),
-                 (int (*)(const void*, const void*, void*))cmp_points,
-                 &c);
+  // Sorting just the order of the points, rather than the points
+  // themselves, means that only one coordinate of each point has to
+  // be looked at.
+  int *perm = malloc(n_points * sizeof(int));
+  assert(perm != NULL);
+  hpps_radix_sort_keys(&points[c], n_points, d*sizeof(double),
+                       HPPS_KEY_DOUBLE, perm);
 
   for (int i = 0; i < n_points; i++) {
     printf("Point %d: ", i);
     for (int j = 0; j < d; j++) {
-      printf("%f ", points[i*d+j]);
+      printf("%f ", points[perm[i]*d+j]);
     }
     printf("\n");
   }
 
+  free(perm);
   free(points);
 }
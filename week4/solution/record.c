@@ -4,171 +4,568 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define NUM_FIELDS 24
+
+// The file is parsed in this many chunks per thread.
+#define CHUNKS_PER_THREAD 4
+
+// The granularity of madvise(); any multiple of the real page size
+// would do.
+#define PAGE_SIZE 4096
 
 // Sanity check to make sure we are reading the right kind of file.
-int input_looks_ok(FILE *f) {
-  char *line = NULL;
-  size_t n;
-  if (getline(&line, &n, f) == -1) {
-    return -1;
+static const char expected_header[] =
+  "name\talternative_names\tosm_type\tosm_id\tclass\ttype\tlon\tlat\t"
+  "place_rank\timportance\tstreet\tcity\tcounty\tstate\tcountry\t"
+  "country_code\tdisplay_name\twest\tsouth\teast\tnorth\twikidata\t"
+  "wikipedia\thousenumbers\n";
+
+// The layout of a binary snapshot, where every part starts at a
+// multiple of 8 bytes:
+//
+//   struct snapshot_header
+//   int64_t osm_id[n]
+//   double lon[n], lat[n], ... for each of double_fields
+//   int32_t place_rank[n], padded to a multiple of 8 bytes
+//   uint64_t offsets[n] for each of string_fields
+//   char blob[blob_size]
+//
+// The offsets point to NUL-terminated strings in the blob.  The blob
+// starts with a NUL, which is shared by all empty strings.  Readers
+// do not depend on the order of the strings in the blob.
+#define SNAPSHOT_MAGIC "OSMREC1"
+
+struct snapshot_header {
+  char magic[8];
+  uint64_t n;
+  uint64_t blob_size;
+};
+
+static const size_t double_fields[] = {
+  offsetof(struct record, lon),
+  offsetof(struct record, lat),
+  offsetof(struct record, importance),
+  offsetof(struct record, west),
+  offsetof(struct record, south),
+  offsetof(struct record, east),
+  offsetof(struct record, north)
+};
+
+static const size_t string_fields[] = {
+  offsetof(struct record, name),
+  offsetof(struct record, alternative_names),
+  offsetof(struct record, osm_type),
+  offsetof(struct record, class),
+  offsetof(struct record, type),
+  offsetof(struct record, street),
+  offsetof(struct record, city),
+  offsetof(struct record, county),
+  offsetof(struct record, state),
+  offsetof(struct record, country),
+  offsetof(struct record, country_code),
+  offsetof(struct record, display_name),
+  offsetof(struct record, wikidata),
+  offsetof(struct record, wikipedia),
+  offsetof(struct record, housenumbers)
+};
+
+#define NUM_DOUBLE_FIELDS (int)(sizeof(double_fields)/sizeof(double_fields[0]))
+#define NUM_STRING_FIELDS (int)(sizeof(string_fields)/sizeof(string_fields[0]))
+
+#define DOUBLE_FIELD(r, f) (*(double*)((char*)(r) + double_fields[f]))
+#define STRING_FIELD(r, f) (*(const char**)((char*)(r) + string_fields[f]))
+
+// The array of records is allocated together with what is needed to
+// free the memory its strings point into, so that free_records() can
+// find it from just the array.
+struct record_block {
+  // The mapping of the file.
+  void *map;
+  size_t map_len;
+
+  // A copy of the last line, if the file does not end with a newline,
+  // as there is then no room in the mapping to terminate it.
+  char *tail;
+
+  struct record rs[];
+};
+
+// Exact powers of ten.  Every integer up to 2^53 and every one of
+// these is exactly representable as a double, so dividing one by the
+// other gives the correctly rounded result, just like strtod().
+static const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parse a number the way atof() does, but much faster for the plain
+// decimals ("-73.9865812") that make up the dataset.  Anything else,
+// such as exponents or more than 15 digits, is left to strtod().
+static double parse_double(const char *s) {
+  const char *p = s;
+  int neg = 0;
+  if (*p == '-' || *p == '+') {
+    neg = *p == '-';
+    p++;
   }
 
-  int ret;
-  if (strcmp(line, "name	alternative_names	osm_type	osm_id	class	type	lon	lat	place_rank	importance	street	city	county	state	country	country_code	display_name	west	south	east	north	wikidata	wikipedia	housenumbers\n") == 0) {
-    ret = 1;
-  } else {
-    ret = 0;
+  uint64_t m = 0;
+  int digits = 0;
+  int frac = 0;
+  while (*p >= '0' && *p <= '9') {
+    m = m*10 + (*p++ - '0');
+    digits++;
+  }
+  if (*p == '.') {
+    p++;
+    while (*p >= '0' && *p <= '9') {
+      m = m*10 + (*p++ - '0');
+      digits++;
+      frac++;
+    }
   }
 
-  free(line);
-  return ret;
+  if (*p != 0 || digits == 0 || digits > 15) {
+    return strtod(s, NULL);
+  }
+  double x = (double)m / powers_of_ten[frac];
+  return neg ? -x : x;
 }
 
-// Read a single record from an open file.  This is pretty tedious, as
-// we handle each field explicitly.
-int read_record(struct record *r, FILE *f) {
-  char *line = NULL;
-  size_t n;
-  if (getline(&line, &n, f) == -1) {
-    free(line);
-    return -1;
+// Like atol().
+static int64_t parse_int(const char *s) {
+  int neg = 0;
+  if (*s == '-' || *s == '+') {
+    neg = *s == '-';
+    s++;
   }
-
-  r->line = line;
-
-  char* start = line;
-  char* end;
-
-  if ((end = strstr(start, "\t"))) {
-    r->name = start; *end = 0; start = end+1;
+  uint64_t x = 0;
+  while (*s >= '0' && *s <= '9') {
+    x = x*10 + (*s++ - '0');
   }
+  return neg ? -(int64_t)x : (int64_t)x;
+}
 
-  if ((end = strstr(start, "\t"))) {
-    r->alternative_names = start; *end = 0; start = end+1;
+// The first tab or newline at or after 'p', or 'end' if there is
+// none.  Fields are short, so calling memchr() for each would mostly
+// be call overhead; instead, 16 bytes are checked at a time with SSE2.
+static char* next_separator(char *p, char *end) {
+#ifdef __SSE2__
+  const __m128i tabs = _mm_set1_epi8('\t');
+  const __m128i newlines = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, tabs),
+                                              _mm_cmpeq_epi8(v, newlines)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
   }
-
-  if ((end = strstr(start, "\t"))) {
-    r->osm_type = start; *end = 0; start = end+1;
+#endif
+  while (p < end && *p != '\t' && *p != '\n') {
+    p++;
   }
+  return p;
+}
 
-  if ((end = strstr(start, "\t"))) {
-    r->osm_id = atol(start); *end = 0; start = end+1;
+// Split the line starting at 'start' into fields by replacing the
+// tabs and the newline with NULs, and return the start of the next
+// line.  There must be a newline before 'end'.  If there are too few
+// fields, the missing ones are empty, and if there are too many, the
+// last one includes the rest of the line.
+static char* read_record(struct record *r, char *start, char *end) {
+  const char *fields[NUM_FIELDS];
+  int n = 0;
+  char *p = start;
+  char *sep;
+  while (1) {
+    sep = n < NUM_FIELDS-1 ? next_separator(p, end) : memchr(p, '\n', end-p);
+    fields[n++] = p;
+    p = sep+1;
+    if (*sep == '\n') {
+      *sep = 0;
+      break;
+    }
+    *sep = 0;
   }
-
-  if ((end = strstr(start, "\t"))) {
-    r->class = start; *end = 0; start = end+1;
+  while (n < NUM_FIELDS) {
+    fields[n++] = sep;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->type = start; *end = 0; start = end+1;
-  }
+  r->name = fields[0];
+  r->alternative_names = fields[1];
+  r->osm_type = fields[2];
+  r->osm_id = parse_int(fields[3]);
+  r->class = fields[4];
+  r->type = fields[5];
+  r->lon = parse_double(fields[6]);
+  r->lat = parse_double(fields[7]);
+  r->place_rank = parse_int(fields[8]);
+  r->importance = parse_double(fields[9]);
+  r->street = fields[10];
+  r->city = fields[11];
+  r->county = fields[12];
+  r->state = fields[13];
+  r->country = fields[14];
+  r->country_code = fields[15];
+  r->display_name = fields[16];
+  r->west = parse_double(fields[17]);
+  r->south = parse_double(fields[18]);
+  r->east = parse_double(fields[19]);
+  r->north = parse_double(fields[20]);
+  r->wikidata = fields[21];
+  r->wikipedia = fields[22];
+  r->housenumbers = fields[23];
+
+  return p;
+}
 
-  if ((end = strstr(start, "\t"))) {
-    r->lon = atof(start); *end = 0; start = end+1;
+// The number of lines from 'start' to 'end', counting a last line
+// without a newline.
+static size_t count_lines(char *start, char *end) {
+  size_t lines = 0;
+  for (char *p = start; p < end; lines++) {
+    char *newline = memchr(p, '\n', end-p);
+    p = newline ? newline+1 : end;
   }
+  return lines;
+}
 
-  if ((end = strstr(start, "\t"))) {
-    r->lat = atof(start); *end = 0; start = end+1;
+// Parse the lines from 'start' to 'end' into 'rs'.  Only the last
+// chunk of the file can end without a newline; that line is parsed
+// from a copy, which is stored in the block.
+static void read_chunk(struct record_block *block, struct record *rs,
+                       char *start, char *end) {
+  char *last = end;
+  if (end > start && end[-1] != '\n') {
+    while (last > start && last[-1] != '\n') {
+      last--;
+    }
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->place_rank = atoi(start); *end = 0; start = end+1;
+  char *p = start;
+  while (p < last) {
+    p = read_record(rs++, p, last);
   }
-
-  if ((end = strstr(start, "\t"))) {
-    r->importance = atof(start); *end = 0; start = end+1;
+  if (last < end) {
+    size_t tail_len = end-last;
+    block->tail = malloc(tail_len+1);
+    memcpy(block->tail, last, tail_len);
+    block->tail[tail_len] = '\n';
+    read_record(rs, block->tail, block->tail+tail_len+1);
   }
+}
 
-  if ((end = strstr(start, "\t"))) {
-    r->street = start; *end = 0; start = end+1;
-  }
+struct record* read_records(const char *filename, int *n) {
+  *n = 0;
 
-  if ((end = strstr(start, "\t"))) {
-    r->city = start; *end = 0; start = end+1;
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->county = start; *end = 0; start = end+1;
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic)
+      && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0) {
+    close(fd);
+    return read_records_bin(filename, n);
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->state = start; *end = 0; start = end+1;
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(expected_header)-1) {
+    close(fd);
+    return NULL;
   }
+  size_t len = st.st_size;
 
-  if ((end = strstr(start, "\t"))) {
-    r->country = start; *end = 0; start = end+1;
+  // A private mapping, so the tabs can be overwritten without changing
+  // the file.
+  char *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->country_code = start; *end = 0; start = end+1;
+  if (memcmp(map, expected_header, sizeof(expected_header)-1) != 0) {
+    munmap(map, len);
+    return NULL;
   }
-
-  if ((end = strstr(start, "\t"))) {
-    r->display_name = start; *end = 0; start = end+1;
+  char *data = map + sizeof(expected_header)-1;
+  char *data_end = map + len;
+
+  // Split the data into chunks of roughly equal size, each starting
+  // at the beginning of a line, which are parsed in parallel.  There
+  // are a few chunks per thread, so a thread that finishes early can
+  // take over another chunk.
+  int n_chunks = CHUNKS_PER_THREAD * omp_get_max_threads();
+  char **bounds = malloc((n_chunks+1) * sizeof(char*));
+  size_t *offsets = malloc((n_chunks+1) * sizeof(size_t));
+  bounds[0] = data;
+  for (int c = 1; c < n_chunks; c++) {
+    char *p = data + (data_end-data) / n_chunks * c;
+    if (p < bounds[c-1]) {
+      p = bounds[c-1];
+    }
+    char *newline = memchr(p, '\n', data_end-p);
+    bounds[c] = newline ? newline+1 : data_end;
   }
-
-  if ((end = strstr(start, "\t"))) {
-    r->west = atof(start); *end = 0; start = end+1;
+  bounds[n_chunks] = data_end;
+
+  // Count the lines of each chunk, so the array can be allocated at
+  // once, and each chunk knows where its records go.
+#pragma omp parallel for schedule(dynamic)
+  for (int c = 0; c < n_chunks; c++) {
+#ifdef MADV_POPULATE_WRITE
+    // Every page will be written to, and so copied, anyway, and doing
+    // that up front for the whole chunk is much faster than taking a
+    // page fault for each.
+    char *page = map + (bounds[c]-map) / PAGE_SIZE * PAGE_SIZE;
+    madvise(page, bounds[c+1]-page, MADV_POPULATE_WRITE);
+#endif
+    offsets[c+1] = count_lines(bounds[c], bounds[c+1]);
+  }
+  offsets[0] = 0;
+  for (int c = 0; c < n_chunks; c++) {
+    offsets[c+1] += offsets[c];
+  }
+  size_t lines = offsets[n_chunks];
+
+  struct record_block *block =
+    malloc(sizeof(struct record_block) + lines * sizeof(struct record));
+  if (block != NULL) {
+    block->map = map;
+    block->map_len = len;
+    block->tail = NULL;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < n_chunks; c++) {
+      read_chunk(block, &block->rs[offsets[c]], bounds[c], bounds[c+1]);
+    }
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->west = atof(start); *end = 0; start = end+1;
+  free(offsets);
+  free(bounds);
+
+  if (block == NULL) {
+    munmap(map, len);
+    return NULL;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->east = atof(start); *end = 0; start = end+1;
+  *n = lines;
+  return block->rs;
+}
+
+void free_records(struct record *rs, int n) {
+  (void)n;
+  struct record_block *block =
+    (struct record_block*)((char*)rs - offsetof(struct record_block, rs));
+  munmap(block->map, block->map_len);
+  free(block->tail);
+  free(block);
+}
+
+// The size of a snapshot of 'n' records with a blob of 'blob_size'
+// bytes.
+static size_t snapshot_size(size_t n, size_t blob_size) {
+  size_t place_rank_size = (n * sizeof(int32_t) + 7) / 8 * 8;
+  return sizeof(struct snapshot_header)
+    + n * sizeof(int64_t)
+    + NUM_DOUBLE_FIELDS * n * sizeof(double)
+    + place_rank_size
+    + NUM_STRING_FIELDS * n * sizeof(uint64_t)
+    + blob_size;
+}
+
+int write_records_bin(FILE *f, const struct record *rs, int n) {
+  // The strings of each record are stored together in the blob, so
+  // using a record touches as few pages of the snapshot as possible.
+  // 'lengths' holds the lengths of the strings of each record, and
+  // 'starts' where they begin in the blob, so both are only computed
+  // in a single pass over the records.
+  uint32_t *lengths = malloc((size_t)n * NUM_STRING_FIELDS * sizeof(uint32_t));
+  uint64_t *starts = malloc(((size_t)n + 1) * sizeof(uint64_t));
+  uint64_t blob_size = 1;
+  for (int i = 0; i < n; i++) {
+    starts[i] = blob_size;
+    for (int j = 0; j < NUM_STRING_FIELDS; j++) {
+      size_t len = strlen(STRING_FIELD(&rs[i], j));
+      lengths[(size_t)i*NUM_STRING_FIELDS+j] = len;
+      blob_size += len > 0 ? len+1 : 0;
+    }
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->north = atof(start); *end = 0; start = end+1;
+  struct snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.n = n;
+  header.blob_size = blob_size;
+  int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+  // Each column is gathered here before writing.
+  size_t buf_size = ((size_t)n + 1) * 8;
+  void *column = malloc(buf_size);
+  int64_t *ints = column;
+  double *doubles = column;
+  int32_t *ranks = column;
+  uint64_t *offsets = column;
+
+  for (int i = 0; i < n; i++) {
+    ints[i] = rs[i].osm_id;
   }
+  ok = ok && fwrite(ints, sizeof(int64_t), n, f) == (size_t)n;
 
-  if ((end = strstr(start, "\t"))) {
-    r->wikidata = start; *end = 0; start = end+1;
+  for (int j = 0; j < NUM_DOUBLE_FIELDS; j++) {
+    for (int i = 0; i < n; i++) {
+      doubles[i] = DOUBLE_FIELD(&rs[i], j);
+    }
+    ok = ok && fwrite(doubles, sizeof(double), n, f) == (size_t)n;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->wikipedia = start; *end = 0; start = end+1;
+  for (int i = 0; i < n; i++) {
+    ranks[i] = rs[i].place_rank;
+  }
+  ranks[n] = 0;
+  ok = ok && fwrite(ranks, sizeof(int32_t), n + n%2, f) == (size_t)(n + n%2);
+
+  for (int j = 0; j < NUM_STRING_FIELDS; j++) {
+    for (int i = 0; i < n; i++) {
+      const uint32_t *len = &lengths[(size_t)i*NUM_STRING_FIELDS];
+      uint64_t offset = starts[i];
+      for (int k = 0; k < j; k++) {
+        offset += len[k] > 0 ? len[k]+1 : 0;
+      }
+      offsets[i] = len[j] > 0 ? offset : 0;
+    }
+    ok = ok && fwrite(offsets, sizeof(uint64_t), n, f) == (size_t)n;
   }
 
-  if ((end = strstr(start, "\t"))) {
-    r->housenumbers = start; *end = 0; start = end+1;
+  // Most strings are short, so they are collected in the column
+  // buffer (now used as bytes) rather than written one at a time.
+  char *buf = column;
+  size_t used = 0;
+  buf[used++] = 0;
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < NUM_STRING_FIELDS; j++) {
+      size_t len = lengths[(size_t)i*NUM_STRING_FIELDS+j];
+      if (len == 0) {
+        continue;
+      }
+      const char *str = STRING_FIELD(&rs[i], j);
+      if (buf_size - used < len+1) {
+        ok = ok && fwrite(buf, 1, used, f) == used;
+        used = 0;
+      }
+      if (buf_size < len+1) {
+        ok = ok && fwrite(str, 1, len+1, f) == len+1;
+      } else {
+        memcpy(buf + used, str, len+1);
+        used += len+1;
+      }
+    }
   }
+  ok = ok && fwrite(buf, 1, used, f) == used;
 
-  return 0;
+  free(column);
+  free(starts);
+  free(lengths);
+  return !ok;
 }
 
-struct record* read_records(const char *filename, int *n) {
-  FILE *f = fopen(filename, "r");
+struct record* read_records_bin(const char *filename, int *n) {
   *n = 0;
 
-  if (f == NULL) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
     return NULL;
   }
 
-  if (!input_looks_ok(f)) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+    close(fd);
     return NULL;
   }
+  size_t len = st.st_size;
 
-  int capacity = 100;
-  int i = 0;
-  struct record *rs = malloc(capacity * sizeof(struct record));
-  while (read_record(&rs[i], f) == 0) {
-    i++;
-    if (i == capacity) {
-      capacity *= 2;
-      rs = realloc(rs, capacity * sizeof(struct record));
-    }
+  // Nothing is written to the snapshot, so the mapping can be shared
+  // with other processes using the same snapshot.
+  char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
   }
 
-  *n = i;
-  fclose(f);
-  return rs;
-}
+  // The blob size is checked against the file size first, as a huge
+  // one would make snapshot_size() wrap around.  With n at most
+  // INT_MAX, the rest of the sum cannot.
+  struct snapshot_header header;
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+      || header.n > INT_MAX
+      || header.blob_size < 1
+      || header.blob_size > len
+      || snapshot_size(header.n, header.blob_size) != len
+      || map[len-1] != 0) {
+    munmap(map, len);
+    return NULL;
+  }
+  size_t records = header.n;
+
+  const char *p = map + sizeof(header);
+  const int64_t *ids = (const int64_t*)p;
+  p += records * sizeof(int64_t);
+  const double *doubles = (const double*)p;
+  p += NUM_DOUBLE_FIELDS * records * sizeof(double);
+  const int32_t *ranks = (const int32_t*)p;
+  p += (records * sizeof(int32_t) + 7) / 8 * 8;
+  const uint64_t *offsets = (const uint64_t*)p;
+  p += NUM_STRING_FIELDS * records * sizeof(uint64_t);
+  const char *blob = p;
+
+  struct record_block *block =
+    malloc(sizeof(struct record_block) + records * sizeof(struct record));
+  if (block == NULL) {
+    munmap(map, len);
+    return NULL;
+  }
+  block->map = map;
+  block->map_len = len;
+  block->tail = NULL;
+
+  // An offset outside the blob means the file is damaged.
+  int bad = 0;
+#pragma omp parallel for reduction(|:bad)
+  for (size_t i = 0; i < records; i++) {
+    struct record *r = &block->rs[i];
+    r->osm_id = ids[i];
+    for (int j = 0; j < NUM_DOUBLE_FIELDS; j++) {
+      DOUBLE_FIELD(r, j) = doubles[j*records + i];
+    }
+    r->place_rank = ranks[i];
+    for (int j = 0; j < NUM_STRING_FIELDS; j++) {
+      uint64_t offset = offsets[j*records + i];
+      bad |= offset >= header.blob_size;
+      STRING_FIELD(r, j) = blob + (offset < header.blob_size ? offset : 0);
+    }
+  }
 
-void free_records(struct record *rs, int n) {
-  for (int i = 0; i < n; i++) {
-    free(rs[i].line);
+  if (bad) {
+    free_records(block->rs, records);
+    return NULL;
   }
-  free(rs);
+
+  *n = records;
+  return block->rs;
 }